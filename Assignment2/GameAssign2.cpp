@@ -3,6 +3,11 @@
 #include "ResourceLoader.h"
 #include "ResourceBundle.h"
 #include "TaskManager.h"
+#include "TaskProfiler.h"
+#include "EvictionPolicies.h"
+#include "ConcurrentResourceTable.h"
+#include "Archiver.h"
+#include "SpinLock.h"
 #include "LoaderOBJ.h"
 #include "LoaderTGA.h"
 #include "LoaderBMP.h"
@@ -12,6 +17,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <imgui.h>
 #include <filesystem>
+#include <thread>
 #include <stdlib.h>     /* srand, rand */
 #include <time.h>       /* time */
 
@@ -31,6 +37,25 @@ const char* UNPACKAGED_RESOURCES_DIR = "Resources";
 
 const char* PACKAGE_HEADER_PATH = "PackageHeader.txt";
 
+struct SceneObject
+{
+	const char* file;
+	glm::vec3 position;
+};
+
+//Where Render() draws each resource, used as streaming hints
+static const SceneObject g_SceneObjects[] =
+{
+	{ "bunny.obj", glm::vec3(2.0f, 0.0f, 0.0f) },
+	{ "teapot.obj", glm::vec3(0.0f, 0.0f, 0.0f) },
+	{ "cube.dae", glm::vec3(-2.0f, 0.0f, 0.0f) },
+	{ "meme.tga", glm::vec3(-2.0f, 0.0f, 0.0f) },
+	{ "M4A1.dae", glm::vec3(-2.0f, 0.0f, 4.5f) },
+	{ "AudiR8.dae", glm::vec3(-2.0f, 1.0f, -4.5f) },
+	{ "stormtrooper.obj", glm::vec3(0.0f, 0.0f, 2.0f) },
+	{ "stormtrooper.tga", glm::vec3(0.0f, 0.0f, 2.0f) },
+};
+
 std::string g_stateChangeName = "";
 static int g_selectedState = -1;
 void GameAssign2::RenderResourceDataInfo()
@@ -64,6 +89,74 @@ void GameAssign2::RenderResourceDataInfo()
 		m_StressTest = !m_StressTest;
 	}
 
+	ImGui::SameLine();
+	if (ImGui::Button(m_StreamScene ? "Stop streaming" : "Stream scene"))
+	{
+		m_StreamScene = !m_StreamScene;
+	}
+
+	ImGui::SameLine();
+	bool isHotReloading = manager->IsHotReloadEnabled();
+	if (ImGui::Checkbox("Hot reload", &isHotReloading))
+	{
+		if (isHotReloading)
+			manager->EnableHotReload({ "Resources" });
+		else
+			manager->DisableHotReload();
+	}
+
+	ImGui::SameLine();
+	bool isRecordingAccess = manager->IsRecordingAccess();
+	if (ImGui::Checkbox("Record access order", &isRecordingAccess))
+	{
+		if (isRecordingAccess)
+			manager->StartAccessRecording();
+		else
+			manager->StopAccessRecording();
+	}
+
+	ImGui::SameLine();
+	if (ImGui::Button(TaskProfiler::IsEnabled() ? "Save task trace" : "Record tasks"))
+	{
+		TaskProfiler& profiler = TaskProfiler::Get();
+		if (TaskProfiler::IsEnabled())
+		{
+			profiler.Disable();
+			profiler.ExportChromeTrace(TASK_TRACE_PATH);
+		}
+		else
+		{
+			profiler.Clear();
+			profiler.Enable();
+		}
+	}
+
+	static const char* policies[] = { "LRU", "LFU", "Size weighted" };
+	static int currentPolicy = 0;
+	ImGui::PushItemWidth(150);
+	if (ImGui::Combo("Eviction policy", &currentPolicy, policies, IM_ARRAYSIZE(policies)))
+	{
+		if (currentPolicy == 0)
+			manager->SetEvictionPolicy(new LRUEvictionPolicy());
+		else if (currentPolicy == 1)
+			manager->SetEvictionPolicy(new LFUEvictionPolicy());
+		else
+			manager->SetEvictionPolicy(new SizeWeightedEvictionPolicy());
+	}
+	ImGui::PopItemWidth();
+
+	ImGui::SameLine();
+	ImGui::Text("Hits: %llu Misses: %llu Evictions: %llu (%.2f kb)", (unsigned long long)manager->GetCacheHits(), (unsigned long long)manager->GetCacheMisses(),
+		(unsigned long long)manager->GetEvictions(), (float)manager->GetEvictedBytes() / 1024);
+
+	const ResourceManager::FinalizeStats& finalizeStats = manager->GetFinalizeStats();
+	ImGui::Text("Finalize: %.2f ms (peak %.2f ms), %.2f kb uploaded, %u finished, %u pending", finalizeStats.milliseconds, manager->GetPeakFinalizeMilliseconds(),
+		(float)finalizeStats.bytesUploaded / 1024, finalizeStats.resourcesFinalized, finalizeStats.resourcesPending);
+
+	const ResourceManager::StreamingStats& streamingStats = manager->GetStreamingStats();
+	ImGui::Text("Streaming: time to visible %.2f ms (max %.2f ms) over %u, %u queued, %u loading, %u cancelled, %u prefetches deferred", streamingStats.averageTimeToVisible,
+		streamingStats.maxTimeToVisible, streamingStats.resourcesVisible, streamingStats.requestsQueued, streamingStats.requestsLoading, streamingStats.requestsCancelled, streamingStats.prefetchesDeferred);
+
 	ImGui::Separator();
 
 	ImGui::Columns(4, "Resources being referenced", true);
@@ -198,13 +291,14 @@ void GameAssign2::Init()
 {
 	srand(time(NULL));
 	m_StressTest = false;
+	m_StreamScene = false;
 	m_Timer = 0;
 #if defined(CREATE_PACKAGE)
 	for (const auto& entry : std::filesystem::directory_iterator(UNPACKAGED_RESOURCES_DIR))
 	{
 		std::string fileNameString = entry.path().filename().string();
 
-		if (ResourceLoader::Get().HasLoaderForFile(fileNameString))
+		if (ResourceLoader::Get().HasLoaderForFile(fileNameString) || entry.path().extension() == BUNDLE_FILE_EXTENSION)
 		{
 			size_t size = (fileNameString.length() + 1) * sizeof(char);
 			char* fileName = (char*)mm_allocate(size, 1, "filename" + fileNameString);
@@ -228,6 +322,10 @@ void GameAssign2::Init()
 
 	//SingleThreadedTest();
 	//MultiThreadedTest();
+	//LookupBenchmark();
+	//PackageReadBenchmark();
+	//CodecBenchmark();
+	//HotReloadAliasTest();
 #endif
 }
 
@@ -261,8 +359,9 @@ void GameAssign2::UseResource(const std::string& file)
 	{
 		if (bundle)
 		{
+			//Bundles are not resources themselves
 			IResource* resource = ResourceManager::Get().GetResource(file);
-			if (!resource->InUse())
+			if (resource && !resource->InUse())
 			{
 				resource->AddRef();
 			}
@@ -301,6 +400,13 @@ void GameAssign2::Update(const sf::Time& deltaTime)
 			ChangeStateOfResource(file, state, resourceStates);
 		}
 	}
+
+	//Requests have to be renewed every frame, objects that are not visible are only prefetched
+	if (m_StreamScene)
+	{
+		for (const SceneObject& object : g_SceneObjects)
+			ResourceManager::Get().RequestStreaming(object.file, m_Camera, object.position);
+	}
 }
 
 void GameAssign2::Render()
@@ -388,43 +494,177 @@ void GameAssign2::MultiThreadedTest()
 	TaskManager& taskManager = TaskManager::Get();
 	IResource** resources = new IResource*[m_ResourcesInCompressedPackage.size()];
 	sf::Clock deltaClock;
-	std::atomic_int finished = 0;
 
 	sf::Time dt = deltaClock.restart();
-	for (int i = 0; i < m_ResourcesInCompressedPackage.size(); i++)
+	taskManager.ParallelFor(0, m_ResourcesInCompressedPackage.size(), 1, [this, resources, &loader](size_t i)
 	{
-		std::string file = m_ResourcesInCompressedPackage[i];
-		taskManager.Execute([this, &resources, &loader, file, i, &finished]
-		{
-			resources[i] = loader.LoadResourceFromDisk("Resources/" + file);
-			finished++;
-		});
-	}
-	while (finished < m_ResourcesInCompressedPackage.size()){}
+		resources[i] = loader.LoadResourceFromDisk("Resources/" + m_ResourcesInCompressedPackage[i]);
+	});
 
 	dt = deltaClock.restart();
 	ThreadSafePrintf("Elapsed time: %f\n", dt.asSeconds());
 
-	for (int i = 0; i < finished; i++)
+	for (int i = 0; i < m_ResourcesInCompressedPackage.size(); i++)
 	{
 		delete resources[i];
 	}
 	delete[] resources;
 
-	finished = 0;
 	dt = deltaClock.restart();
+	std::vector<AsyncTask<Ref<ResourceBundle>>> loadTasks;
+	loadTasks.reserve(m_ResourcesInCompressedPackage.size());
 	for (int i = 0; i < m_ResourcesInCompressedPackage.size(); i++)
 	{
-		resourceManager.LoadResourcesInBackground({ m_ResourcesInCompressedPackage[i].c_str() }, [this, &finished](const Ref<ResourceBundle>& bundle)
-		{
-			finished++;
-		});
+		loadTasks.push_back(resourceManager.LoadAsync({ m_ResourcesInCompressedPackage[i].c_str() }));
+		loadTasks.back().Start();
+	}
+
+	for (AsyncTask<Ref<ResourceBundle>>& task : loadTasks)
+	{
+		task.Wait();
 	}
-	while (finished < m_ResourcesInCompressedPackage.size()) {}
 	dt = deltaClock.restart();
 	ThreadSafePrintf("Elapsed time: %f\n", dt.asSeconds());
 }
 
+void GameAssign2::LookupBenchmark()
+{
+	constexpr size_t nrOfResources = 1024;
+	constexpr size_t lookupsPerThread = 4 * 1024 * 1024;
+	const uint32_t threadCounts[] = { 1, 4, 16 };
+
+	//The entries are never dereferenced, any distinct non null pointers will do
+	std::vector<char> dummyResources(nrOfResources);
+	std::vector<size_t> guids(nrOfResources);
+	std::unordered_map<size_t, IResource*> map;
+	SpinLock mapLock;
+	ConcurrentResourceTable table;
+	for (size_t i = 0; i < nrOfResources; i++)
+	{
+		guids[i] = HashString(std::to_string(i).c_str());
+		map.insert({ guids[i], (IResource*)&dummyResources[i] });
+		table.Insert(guids[i], (IResource*)&dummyResources[i]);
+	}
+
+	auto measure = [&](uint32_t nrOfThreads, const std::function<IResource*(size_t)>& lookup)
+	{
+		std::atomic<size_t> found = 0;
+		std::vector<std::thread> threads;
+		sf::Clock clock;
+		for (uint32_t t = 0; t < nrOfThreads; t++)
+		{
+			threads.emplace_back([&, t]
+			{
+				size_t foundLocal = 0;
+				for (size_t i = 0; i < lookupsPerThread; i++)
+				{
+					if (lookup(guids[(i * 7 + t) % nrOfResources]))
+						foundLocal++;
+				}
+				found += foundLocal;
+			});
+		}
+
+		for (std::thread& thread : threads)
+			thread.join();
+
+		float seconds = clock.getElapsedTime().asSeconds();
+		assert(found == nrOfThreads * lookupsPerThread);
+		return float(nrOfThreads * lookupsPerThread) / seconds / 1000000.0f;
+	};
+
+	for (uint32_t nrOfThreads : threadCounts)
+	{
+		float mapThroughput = measure(nrOfThreads, [&](size_t guid)
+		{
+			std::scoped_lock<SpinLock> lock(mapLock);
+			auto iterator = map.find(guid);
+			return iterator != map.end() ? iterator->second : nullptr;
+		});
+
+		float tableThroughput = measure(nrOfThreads, [&](size_t guid)
+		{
+			return table.Find(guid);
+		});
+
+		ThreadSafePrintf("Lookups with %u threads: locked map %.1f M/s, concurrent table %.1f M/s\n", nrOfThreads, mapThroughput, tableThroughput);
+	}
+}
+
+void GameAssign2::PackageReadBenchmark()
+{
+	constexpr uint32_t nrOfPasses = 4;
+	const uint32_t workerCounts[] = { 1, 2, 4, 8, 16 };
+
+	//Has to run before anything else opens the package, the mode cannot change once it is open
+	Archiver& archiver = Archiver::GetInstance();
+	archiver.OpenCompressedPackage(PACKAGE_PATH, Archiver::LOAD_AND_PREPARE);
+	if (archiver.GetPackageMode(PACKAGE_PATH) != Archiver::LOAD_AND_PREPARE)
+		ThreadSafePrintf("Package is already open in another mode, the results are not for LOAD_AND_PREPARE\n");
+
+	std::vector<size_t> hashes;
+	for (const std::string& file : m_ResourcesInCompressedPackage)
+		hashes.push_back(HashString(file.c_str()));
+
+	for (uint32_t nrOfWorkers : workerCounts)
+	{
+		std::atomic<size_t> nextEntry = 0;
+		std::atomic<size_t> bytesRead = 0;
+		std::vector<std::thread> workers;
+		sf::Clock clock;
+		for (uint32_t w = 0; w < nrOfWorkers; w++)
+		{
+			workers.emplace_back([&]
+			{
+				for (size_t i = nextEntry++; i < hashes.size() * nrOfPasses; i = nextEntry++)
+				{
+					size_t hash = hashes[i % hashes.size()];
+					size_t size = archiver.ReadRequiredSizeForPackageData(hash);
+					if (size == 0)
+						continue;
+
+					size_t typeHash = 0;
+					void* pBuffer = mm_allocate(size, 1, "Package read benchmark");
+					if (archiver.ReadPackageData(hash, typeHash, pBuffer, size))
+						bytesRead += size;
+
+					mm_free(pBuffer);
+				}
+			});
+		}
+
+		for (std::thread& worker : workers)
+			worker.join();
+
+		float seconds = clock.getElapsedTime().asSeconds();
+		ThreadSafePrintf("Package read with %u workers: %.2f ms, %.1f MB/s\n", nrOfWorkers, seconds * 1000.0f, float(bytesRead) / (1024.0f * 1024.0f) / seconds);
+	}
+
+	//The same passes as one batch, which goes through io_uring where it is available
+	std::vector<Archiver::PackageRead> reads;
+	for (size_t hash : hashes)
+	{
+		size_t size = archiver.ReadRequiredSizeForPackageData(hash);
+		if (size > 0)
+			reads.push_back({ hash, mm_allocate(size, 1, "Package read benchmark"), size, 0, false });
+	}
+
+	size_t bytesRead = 0;
+	sf::Clock clock;
+	for (uint32_t pass = 0; pass < nrOfPasses; pass++)
+	{
+		archiver.ReadPackageDataBatch(reads.data(), reads.size());
+		for (const Archiver::PackageRead& read : reads)
+			bytesRead += read.isRead ? read.bufSize : 0;
+	}
+
+	float seconds = clock.getElapsedTime().asSeconds();
+	ThreadSafePrintf("Package read as batch: %.2f ms, %.1f MB/s\n", seconds * 1000.0f, float(bytesRead) / (1024.0f * 1024.0f) / seconds);
+
+	for (Archiver::PackageRead& read : reads)
+		mm_free(read.pBuf);
+}
+
 void GameAssign2::RenderImGui()
 {
 #if defined(CREATE_PACKAGE)
@@ -432,6 +672,8 @@ void GameAssign2::RenderImGui()
 	{
 		static bool packageSaved = false;
 		static size_t packageSavedCounter = 0;
+		static bool isIncremental = true;
+		static bool isOrderedByAccess = false;
 
 		ImGui::BeginChild("", ImVec2(ImGui::GetWindowWidth(), 20));
 		if (m_ResourcesInPackage.size() > 0)
@@ -439,7 +681,7 @@ void GameAssign2::RenderImGui()
 			if (ImGui::Button("Create Package", ImVec2(120, 20)))
 			{
 				//create package
-				ResourceManager::Get().CreateResourcePackage(std::string(UNPACKAGED_RESOURCES_DIR) + "/", m_ResourcesInPackage);
+				ResourceManager::Get().CreateResourcePackage(std::string(UNPACKAGED_RESOURCES_DIR) + "/", m_ResourcesInPackage, isIncremental, isOrderedByAccess);
 
 				std::ofstream fileStream;
 				fileStream.open(PACKAGE_HEADER_PATH, std::ios_base::out);
@@ -456,6 +698,11 @@ void GameAssign2::RenderImGui()
 
 				packageSaved = true;
 			}
+
+			ImGui::SameLine();
+			ImGui::Checkbox("Incremental", &isIncremental);
+			ImGui::SameLine();
+			ImGui::Checkbox("Order by access", &isOrderedByAccess);
 		}
 			
 		if (packageSaved)
@@ -552,3 +799,148 @@ void GameAssign2::Release()
 		mm_free(m_ResourcesInPackage[i]);
 	}
 }
+
+void GameAssign2::CodecBenchmark()
+{
+	constexpr uint32_t nrOfPasses = 8;
+	const std::pair<Archiver::PackageCodec, const char*> codecs[] =
+	{
+		{ Archiver::CODEC_DEFLATE, "Deflate" },
+		{ Archiver::CODEC_LZ4, "LZ4" },
+		{ Archiver::CODEC_DEFLATE_DICTIONARY, "Deflate + dictionary" },
+	};
+
+	struct Sample
+	{
+		size_t typeHash;
+		void* pData;
+		size_t size;
+	};
+
+	Archiver& archiver = Archiver::GetInstance();
+	archiver.OpenCompressedPackage(PACKAGE_PATH, PACKAGE_MODE);
+
+	std::vector<Sample> samples;
+	std::unordered_map<size_t, std::vector<std::pair<const void*, size_t>>> samplesPerType;
+	for (const std::string& file : m_ResourcesInCompressedPackage)
+	{
+		size_t hash = HashString(file.c_str());
+		size_t size = archiver.ReadRequiredSizeForPackageData(hash);
+		if (size == 0)
+			continue;
+
+		Sample sample = { 0, mm_allocate(size, 1, "Codec benchmark"), size };
+		if (!archiver.ReadPackageData(hash, sample.typeHash, sample.pData, size))
+		{
+			mm_free(sample.pData);
+			continue;
+		}
+
+		samples.push_back(sample);
+		samplesPerType[sample.typeHash].push_back({ sample.pData, sample.size });
+	}
+
+	//Dictionaries are trained per type, the same way the package builder does it
+	std::unordered_map<size_t, std::string> dictionaries;
+	for (auto& it : samplesPerType)
+		dictionaries[it.first] = Archiver::TrainDictionary(it.second, PACKAGE_DICTIONARY_SIZE);
+
+	for (const std::pair<Archiver::PackageCodec, const char*>& codec : codecs)
+	{
+		size_t uncompressedSize = 0;
+		size_t compressedSize = 0;
+		std::vector<std::pair<void*, size_t>> compressed;
+		for (const Sample& sample : samples)
+		{
+			const std::string& dictionary = dictionaries[sample.typeHash];
+			size_t bufSize = Lz4::GetCompressBound(sample.size) + 64;
+			void* pCompressed = mm_allocate(std::max(bufSize, size_t(compressBound(uLong(sample.size)))), 1, "Codec benchmark");
+			size_t size = Archiver::CompressData(codec.first, sample.pData, sample.size, pCompressed, bufSize, dictionary.data(), dictionary.size());
+			compressed.push_back({ pCompressed, size });
+			uncompressedSize += sample.size;
+			compressedSize += size;
+		}
+
+		bool isValid = true;
+		sf::Clock clock;
+		for (uint32_t pass = 0; pass < nrOfPasses; pass++)
+		{
+			for (size_t i = 0; i < samples.size(); i++)
+			{
+				const std::string& dictionary = dictionaries[samples[i].typeHash];
+				void* pBuffer = mm_allocate(samples[i].size, 1, "Codec benchmark");
+				isValid = Archiver::DecompressData(codec.first, compressed[i].first, compressed[i].second, pBuffer, samples[i].size, dictionary.data(), dictionary.size()) && isValid;
+				isValid = memcmp(pBuffer, samples[i].pData, samples[i].size) == 0 && isValid;
+				mm_free(pBuffer);
+			}
+		}
+
+		float seconds = clock.getElapsedTime().asSeconds();
+		float megabytes = float(uncompressedSize * nrOfPasses) / (1024.0f * 1024.0f);
+		ThreadSafePrintf("%s: ratio %.3f, decode %.1f MB/s%s\n", codec.second, float(compressedSize) / float(uncompressedSize), megabytes / seconds, isValid ? "" : " (MISMATCH)");
+
+		for (std::pair<void*, size_t>& entry : compressed)
+			mm_free(entry.first);
+	}
+
+	for (Sample& sample : samples)
+		mm_free(sample.pData);
+}
+
+void GameAssign2::HotReloadAliasTest()
+{
+	Archiver& archiver = Archiver::GetInstance();
+	archiver.OpenCompressedPackage(PACKAGE_PATH, PACKAGE_MODE);
+
+	//Identical files are stored once, every one but the first is an alias of it
+	std::string edited;
+	std::string identical;
+	for (const std::string& file : m_ResourcesInCompressedPackage)
+	{
+		size_t hash = HashString(file.c_str());
+		size_t canonicalHash = archiver.GetPackageEntryCanonical(hash);
+		if (canonicalHash != hash)
+		{
+			edited = file;
+			identical = archiver.GetPackageEntryName(canonicalHash);
+			break;
+		}
+	}
+
+	if (edited.empty())
+	{
+		ThreadSafePrintf("Hot reload alias test skipped, the package has no identical files\n");
+		return;
+	}
+
+	ResourceManager& resourceManager = ResourceManager::Get();
+	Ref<ResourceBundle> bundle = resourceManager.LoadResources({ edited, identical });
+	resourceManager.FinalizeResources(1000.0f, SIZE_MAX);
+	IResource* pShared = resourceManager.GetResource(identical);
+
+	bool wasHotReloading = resourceManager.IsHotReloadEnabled();
+	resourceManager.EnableHotReload({ "Resources" });
+
+	//Writing the file back unchanged is enough to be seen as an edit
+	std::string path = std::string("Resources/") + edited;
+	std::ifstream input(path, std::ios::binary);
+	std::string content((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+	input.close();
+	std::ofstream output(path, std::ios::binary | std::ios::trunc);
+	output.write(content.data(), content.size());
+	output.close();
+
+	//A swap would leave the shared resource waiting for its upload, so only the main thread tasks are run
+	sf::Clock clock;
+	while (clock.getElapsedTime().asSeconds() < 2.0f)
+	{
+		TaskManager::Get().ExecuteMainThreadTasks(MAIN_THREAD_TASK_BUDGET_MS);
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	bool isPassed = pShared && pShared->IsReady() && resourceManager.GetResource(edited) == pShared && resourceManager.GetResource(identical) == pShared;
+	ThreadSafePrintf("Hot reload alias test [%s] and [%s]: %s\n", edited.c_str(), identical.c_str(), isPassed ? "passed" : "FAILED");
+
+	if (!wasHotReloading)
+		resourceManager.DisableHotReload();
+}
@@ -32,8 +32,17 @@ private:
 	std::vector<char*> m_ResourcesNotInPackage;
 	std::vector<char*> m_ResourcesInPackage;
 	bool m_StressTest;
+	bool m_StreamScene;
 	int m_Timer;
 
 	void SingleThreadedTest();
 	void MultiThreadedTest();
+	//Compares lookup throughput of the resource table against a locked std::unordered_map
+	void LookupBenchmark();
+	//Reads every package entry with 1 to 16 workers
+	void PackageReadBenchmark();
+	//Compression ratio and decode speed of every package codec on the packaged resources
+	void CodecBenchmark();
+	//Rewrites one of two identical packaged files with hot reload enabled, the resource they share must be left alone
+	void HotReloadAliasTest();
 };
@@ -1,4 +1,16 @@
 #include "Archiver.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#if defined(__linux__) || defined(__APPLE__)
+	#define ARCHIVER_POSIX_IO
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <cerrno>
+#endif
 
 #define ARCHIVER_CHECK_ERR(err, msg) { \
     if (err != Z_OK) { \
@@ -32,168 +44,216 @@ static alloc_func zalloc = ArchiverAlloc;
 static free_func zfree = ArchiverFree;
 
 Archiver::Archiver()
+	: m_IsRecordingAccess(false),
+	m_IsIoUringChecked(false),
+	m_IsIoThreadStopping(false)
 {
+	m_pMountIndex = std::make_shared<MountIndex>();
+
+	//Constructing the memory manager first makes it outlive the archiver, which frees the package table on destruction.
+	//The same goes for the task manager the I/O thread resumes coroutines on
+	MemoryManager::GetInstance();
+	TaskManager::Get();
 }
 
 Archiver::~Archiver()
 {
+	{
+		std::scoped_lock<std::mutex> lock(m_IoQueueLock);
+		m_IsIoThreadStopping = true;
+	}
+
+	m_IoQueueCondition.notify_one();
+	if (m_IoThread.joinable())
+		m_IoThread.join();
 }
 
-size_t Archiver::ReadPackageHeader(std::ifstream& fileStream)
+size_t Archiver::ReadPackageHeader(Package& package, std::ifstream& fileStream)
 {
-	void* pDecompressedHeader = DecompressHeader(fileStream);
-	std::string decompressedHeaderString = reinterpret_cast<char*>(pDecompressedHeader);
-	std::stringstream headerStream(decompressedHeaderString, std::ios_base::in);
+	//A package that failed to map reads the header again
+	if (package.pTable != nullptr)
+	{
+		MemoryManager::GetInstance().Free(package.pTable);
+		package.pTable = nullptr;
+		package.numRecords = 0;
+	}
 
-	size_t tableEntries;
-	size_t dataSize;
-	headerStream >> tableEntries;
-	headerStream >> dataSize;
+	size_t tableSize = 0;
+	void* pTable = DecompressHeader(fileStream, tableSize, package.filename);
+	if (!pTable)
+		return 0;
 
-	for (size_t i = 0; i < tableEntries; i++)
+	//Check that every section fits before pointing into the table
+	const PackageTableInfo* pInfo = reinterpret_cast<const PackageTableInfo*>(pTable);
+	size_t remaining = tableSize >= sizeof(PackageTableInfo) ? tableSize - sizeof(PackageTableInfo) : 0;
+	bool isValid = tableSize >= sizeof(PackageTableInfo);
+	isValid = isValid && pInfo->entryCount <= remaining / (sizeof(PackageRecord) + sizeof(PackageSourceInfo));
+	remaining -= isValid ? pInfo->entryCount * (sizeof(PackageRecord) + sizeof(PackageSourceInfo)) : 0;
+	isValid = isValid && pInfo->dependencyCount <= remaining / sizeof(uint64_t);
+	remaining -= isValid ? pInfo->dependencyCount * sizeof(uint64_t) : 0;
+	isValid = isValid && pInfo->blockCount <= remaining / sizeof(uint32_t);
+	remaining -= isValid ? pInfo->blockCount * sizeof(uint32_t) : 0;
+	isValid = isValid && pInfo->stringsSize <= remaining && pInfo->blockSize > 0;
+
+	size_t recordsStart = sizeof(PackageTableInfo);
+	size_t sourcesStart = recordsStart + (isValid ? pInfo->entryCount * sizeof(PackageRecord) : 0);
+	size_t dependenciesStart = sourcesStart + (isValid ? pInfo->entryCount * sizeof(PackageSourceInfo) : 0);
+	size_t blocksStart = dependenciesStart + (isValid ? pInfo->dependencyCount * sizeof(uint64_t) : 0);
+	size_t stringsStart = blocksStart + (isValid ? pInfo->blockCount * sizeof(uint32_t) : 0);
+	const PackageRecord* pRecords = reinterpret_cast<const PackageRecord*>((char*)pTable + recordsStart);
+	const uint32_t* pBlocks = reinterpret_cast<const uint32_t*>((char*)pTable + blocksStart);
+
+	//The records are used in place and the mapped mode copies straight from the data they point at, so every one of
+	//them has to stay inside its sections
+	for (size_t i = 0; isValid && i < pInfo->entryCount; i++)
+		isValid = IsPackageRecordValid(*pInfo, pRecords[i], pBlocks) && (i == 0 || pRecords[i - 1].hash < pRecords[i].hash);
+
+	if (!isValid)
 	{
-		size_t hash;
-		size_t typeHash;
-		size_t offset;
-		size_t uncompressedSize;
-		size_t compressedSize;
+		ThreadSafePrintf("Package table of [%s] is corrupt!\n", package.filename.c_str());
+		MemoryManager::GetInstance().Free(pTable);
+		return 0;
+	}
 
-		headerStream >> hash;
-		headerStream >> typeHash;
-		headerStream >> offset;
-		headerStream >> uncompressedSize;
-		headerStream >> compressedSize;
+	package.pTable = pTable;
+	package.pRecords = pRecords;
+	package.numRecords = pInfo->entryCount;
+	package.pSources = reinterpret_cast<const PackageSourceInfo*>((char*)pTable + sourcesStart);
+	package.pDependencies = reinterpret_cast<const uint64_t*>((char*)pTable + dependenciesStart);
+	package.pBlocks = pBlocks;
+	package.numBlocks = pInfo->blockCount;
+	package.blockSize = pInfo->blockSize;
+	package.pStrings = (const char*)pTable + stringsStart;
+
+	//Deduplicated entries are the ones that point at the same data, empty entries can share an offset without sharing anything
+	std::unordered_map<uint64_t, std::vector<uint64_t>> entriesByOffset;
+	for (size_t i = 0; i < package.numRecords; i++)
+	{
+		const PackageRecord& record = package.pRecords[i];
+		if (record.uncompressedSize > 0)
+			entriesByOffset[record.offset].push_back(record.hash);
+	}
 
-		m_CompressedPackage.table[hash] = PackageEntryDescriptor(typeHash, offset, uncompressedSize, compressedSize);
+	package.sharedEntries.clear();
+	for (auto& it : entriesByOffset)
+	{
+		if (it.second.size() > 1)
+			package.sharedEntries.emplace(it.first, std::move(it.second));
 	}
 
-	MemoryManager::GetInstance().Free(pDecompressedHeader);
-	return dataSize;
+	return pInfo->dataSize;
 }
 
-void Archiver::OpenCompressedPackage(const std::string& filename, PackageMode packageMode)
+bool Archiver::IsPackageRecordValid(const PackageTableInfo& info, const PackageRecord& record, const uint32_t* pBlocks)
 {
-	std::scoped_lock<SpinLock> lock(m_OpenPackageLock);
-
-	if (!m_CompressedPackage.isPackageOpen)
-	{
-		m_CompressedPackage.filename = filename + PACKAGE_FILE_EXTENSION;
-		m_CompressedPackage.isPackageOpen = true;
-		m_CompressedPackage.packageMode = packageMode;
-
-		switch (packageMode)
-		{
-			case LOAD_AND_STORE:
-			{
-				std::ifstream fileStream;
-				fileStream.open(filename + PACKAGE_FILE_EXTENSION, std::ios::in | std::ios::binary);
+	uint64_t storedSize = record.compressedSize > 0 ? record.compressedSize : record.uncompressedSize;
+	if (storedSize > info.dataSize || record.offset > info.dataSize - storedSize)
+		return false;
 
-				if (fileStream.is_open())
-				{
-					size_t dataSize = ReadPackageHeader(fileStream);
+	if (record.nameLength > info.stringsSize || record.nameOffset > info.stringsSize - record.nameLength)
+		return false;
 
-					m_CompressedPackage.pData = MemoryManager::GetInstance().Allocate(dataSize, 1, "Package Data");
-					fileStream.read(reinterpret_cast<char*>(m_CompressedPackage.pData), dataSize);
-					//std::cout << "Loaded Data: " << reinterpret_cast<char*>(m_CompressedPackage.pData) << std::endl;
-					fileStream.close();
-				}
+	if (uint64_t(record.firstDependency) + record.dependencyCount > info.dependencyCount)
+		return false;
 
-				break;
-			}
-			case LOAD_AND_PREPARE:
-			{
-				m_CompressedPackage.pFileStream = new std::ifstream();
-				m_CompressedPackage.pFileStream->open(filename + PACKAGE_FILE_EXTENSION, std::ios::in | std::ios::binary);
+	if (record.compressedSize == 0 || record.uncompressedSize <= info.blockSize)
+		return true;
 
-				std::ifstream& fileStream = *m_CompressedPackage.pFileStream;
+	//Blocks of one entry are stored back to back, together they have to be exactly its compressed data
+	uint64_t blockCount = record.uncompressedSize / info.blockSize + (record.uncompressedSize % info.blockSize != 0);
+	if (blockCount > info.blockCount || record.firstBlock > info.blockCount - blockCount)
+		return false;
 
-				if (fileStream.is_open())
-				{
-					ReadPackageHeader(fileStream);
+	uint64_t blocksSize = 0;
+	for (uint64_t block = 0; block < blockCount; block++)
+		blocksSize += pBlocks[record.firstBlock + block];
 
-					m_CompressedPackage.fileDataStart = fileStream.tellg();
-					m_CompressedPackage.pFileStream = &fileStream;
-				}
-				break;
-			}
-			default:
-			{
-				assert(false);
-				break;
-			}
-		}
-	}
+	return blocksSize == record.compressedSize;
 }
 
-void Archiver::CloseCompressedPackage()
+const Archiver::PackageRecord* Archiver::FindPackageRecord(const Package& package, size_t hash)
 {
-	assert(m_CompressedPackage.isPackageOpen);
-	assert(!m_CompressedPackage.pFileStream->is_open());
+	const PackageRecord* pBegin = package.pRecords;
+	const PackageRecord* pEnd = pBegin + package.numRecords;
+	const PackageRecord* pRecord = std::lower_bound(pBegin, pEnd, hash, [](const PackageRecord& record, size_t hash)
+	{
+		return record.hash < hash;
+	});
+
+	if (pRecord == pEnd || pRecord->hash != hash)
+		return nullptr;
 
-	m_CompressedPackage.Reset();
+	return pRecord;
 }
 
-size_t Archiver::ReadRequiredSizeForPackageData(size_t hash)
+void Archiver::OpenCompressedPackage(const std::string& filename, PackageMode packageMode)
 {
-	auto packageTableEntry = m_CompressedPackage.table.find(hash);
-	if (packageTableEntry == m_CompressedPackage.table.end())
-		return 0;
-
-	return packageTableEntry->second.uncompressedSize;
+	MountPackage(filename, packageMode, PACKAGE_BASE_PRIORITY);
 }
 
-bool Archiver::ReadPackageData(size_t hash, size_t& typeHash, void* pBuf, size_t bufSize)
+bool Archiver::MountPackage(const std::string& filename, PackageMode packageMode, int32_t priority)
 {
-	auto packageTableEntry = m_CompressedPackage.table.find(hash);
-	if(packageTableEntry == m_CompressedPackage.table.end())
-		return false;
+	std::scoped_lock<SpinLock> lock(m_OpenPackageLock);
 
-	if (bufSize < packageTableEntry->second.uncompressedSize)
-		return false;
+	Package* pMounted = FindMount(filename);
+	if (pMounted)
+		return pMounted->pRecords != nullptr;
 
-	typeHash = packageTableEntry->second.typeHash;
-	void* pCompressedStart = nullptr;
+	std::shared_ptr<Package> pPackage = std::make_shared<Package>();
+	Package& package = *pPackage;
+	package.mountPath = filename;
+	package.priority = priority;
+	package.filename = filename + PACKAGE_FILE_EXTENSION;
+	package.isPackageOpen = true;
+	package.packageMode = packageMode;
 
-	switch (m_CompressedPackage.packageMode)
+	switch (packageMode)
 	{
 		case LOAD_AND_STORE:
 		{
-			if (packageTableEntry->second.compressedSize > 0)
-			{
-				pCompressedStart = reinterpret_cast<void*>((size_t)m_CompressedPackage.pData + packageTableEntry->second.offset);
-			}
-			else
+			std::ifstream fileStream;
+			fileStream.open(package.filename, std::ios::in | std::ios::binary);
+
+			if (fileStream.is_open())
 			{
-				memcpy(pBuf, (void*)((size_t)m_CompressedPackage.pData + packageTableEntry->second.offset), packageTableEntry->second.uncompressedSize);
-				return true;
+				size_t dataSize = ReadPackageHeader(package, fileStream);
+				if (dataSize > 0)
+				{
+					package.pData = MemoryManager::GetInstance().Allocate(dataSize, 1, "Package Data");
+					fileStream.read(reinterpret_cast<char*>(package.pData), dataSize);
+				}
+				//std::cout << "Loaded Data: " << reinterpret_cast<char*>(package.pData) << std::endl;
+				fileStream.close();
 			}
+
 			break;
 		}
+		case LOAD_MAPPED:
+		{
+			if (MapPackage(package))
+				break;
+
+			ThreadSafePrintf("Could not map [%s], falling back to LOAD_AND_PREPARE!\n", package.filename.c_str());
+			package.packageMode = LOAD_AND_PREPARE;
+			[[fallthrough]];
+		}
 		case LOAD_AND_PREPARE:
 		{
-			assert(m_CompressedPackage.pFileStream != nullptr);
+			package.pFileStream = new std::ifstream();
+			package.pFileStream->open(package.filename, std::ios::in | std::ios::binary);
 
-			{
-				std::scoped_lock<SpinLock> lock(m_FileStreamLock);
+			std::ifstream& fileStream = *package.pFileStream;
 
-				std::ifstream& fileStream = *m_CompressedPackage.pFileStream;
-				if (m_CompressedPackage.pFileStream->is_open())
-				{
-					fileStream.seekg(m_CompressedPackage.fileDataStart + packageTableEntry->second.offset, std::ios_base::beg);
+			if (fileStream.is_open())
+			{
+				ReadPackageHeader(package, fileStream);
 
-					if (packageTableEntry->second.compressedSize > 0)
-					{
-						pCompressedStart = MemoryManager::GetInstance().Allocate(packageTableEntry->second.compressedSize, 1, "Package Data");
-						fileStream.read(reinterpret_cast<char*>(pCompressedStart), packageTableEntry->second.compressedSize);
-					}
-					else
-					{
-						fileStream.read(reinterpret_cast<char*>(pBuf), packageTableEntry->second.uncompressedSize);
-						return true;
-					}
-				}
+				package.fileDataStart = fileStream.tellg();
+#ifdef ARCHIVER_POSIX_IO
+				//Positional reads do not share a file position, so workers can read entries in parallel
+				package.fileDescriptor = open(package.filename.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
 			}
-
 			break;
 		}
 		default:
@@ -203,203 +263,2094 @@ bool Archiver::ReadPackageData(size_t hash, size_t& typeHash, void* pBuf, size_t
 		}
 	}
 
-	int err;
-	z_stream decompressionStream;
-	decompressionStream.zalloc = zalloc;
-	decompressionStream.zfree = zfree;
-	decompressionStream.opaque = nullptr;
+	//A package that cannot be read stays mounted without entries, so it is not tried again on every load
+	bool isRead = package.pRecords != nullptr;
+	if (!isRead)
+		ThreadSafePrintf("Mounted [%s] without entries, it could not be read!\n", package.filename.c_str());
 
-	err = inflateInit(&decompressionStream);
-	ARCHIVER_CHECK_ERR(err, "inflateInit");
+	AddMount(std::move(pPackage));
+	return isRead;
+}
 
-	//std::cout << "Loaded Data: " << reinterpret_cast<char*>(pCompressedStart) << std::endl;
+bool Archiver::MountDirectory(const std::string& directory, const std::vector<LooseFile>& files, int32_t priority, const DirectoryImporter& importer)
+{
+	std::scoped_lock<SpinLock> lock(m_OpenPackageLock);
 
-	decompressionStream.next_in = reinterpret_cast<Byte*>(pCompressedStart);
-	decompressionStream.next_out = reinterpret_cast<Byte*>(pBuf);
-	decompressionStream.avail_in = (uInt)packageTableEntry->second.compressedSize;
-	decompressionStream.avail_out = (uInt)packageTableEntry->second.uncompressedSize;
+	if (FindMount(directory))
+		return true;
 
-	err = inflate(&decompressionStream, Z_FINISH);
-	assert(err > Z_OK);
+	std::vector<const LooseFile*> sortedFiles;
+	for (const LooseFile& file : files)
+		sortedFiles.push_back(&file);
 
-	err = inflateEnd(&decompressionStream);
-	ARCHIVER_CHECK_ERR(err, "inflateEnd");
+	std::sort(sortedFiles.begin(), sortedFiles.end(), [](const LooseFile* pFirst, const LooseFile* pSecond)
+	{
+		return pFirst->hash < pSecond->hash;
+	});
+
+	size_t stringsSize = 0;
+	for (const LooseFile* pFile : sortedFiles)
+		stringsSize += pFile->name.size();
+
+	//The files get records like a package, so everything but reading the data works the same for both
+	std::shared_ptr<Package> pPackage = std::make_shared<Package>();
+	Package& package = *pPackage;
+	package.mountPath = directory;
+	package.priority = priority;
+	package.filename = directory.empty() || directory.back() == '/' ? directory : directory + "/";
+	package.isPackageOpen = true;
+	package.packageMode = MOUNT_DIRECTORY;
+	package.blockSize = PACKAGE_BLOCK_SIZE;
+	package.importer = importer;
+
+	size_t tableSize = sortedFiles.size() * sizeof(PackageRecord) + stringsSize;
+	if (tableSize > 0)
+	{
+		package.pTable = MemoryManager::GetInstance().Allocate(tableSize, alignof(PackageRecord), "Package Table");
+		memset(package.pTable, 0, tableSize);
+	}
 
-	if (m_CompressedPackage.packageMode == LOAD_AND_PREPARE)
-		MemoryManager::GetInstance().Free(pCompressedStart);
+	PackageRecord* pRecords = reinterpret_cast<PackageRecord*>(package.pTable);
+	char* pStrings = reinterpret_cast<char*>(pRecords + sortedFiles.size());
+	size_t numRecords = 0;
+	size_t nameOffset = 0;
+	for (const LooseFile* pFile : sortedFiles)
+	{
+		if (numRecords > 0 && pRecords[numRecords - 1].hash == pFile->hash)
+		{
+			ThreadSafePrintf("Warning! [%s] has the same hash as another file in [%s] and is not mounted\n", pFile->name.c_str(), directory.c_str());
+			continue;
+		}
+
+		PackageRecord& record = pRecords[numRecords++];
+		record.hash = pFile->hash;
+		record.typeHash = pFile->typeHash;
+		record.nameOffset = uint32_t(nameOffset);
+		record.nameLength = uint32_t(pFile->name.size());
+		record.codec = CODEC_NONE;
+		memcpy(pStrings + nameOffset, pFile->name.data(), pFile->name.size());
+		nameOffset += pFile->name.size();
+	}
+
+	package.pRecords = pRecords;
+	package.numRecords = numRecords;
+	package.pStrings = pStrings;
+	package.looseEntries.resize(numRecords);
 
+	AddMount(std::move(pPackage));
 	return true;
 }
 
-void Archiver::CreateUncompressedPackage()
+bool Archiver::Unmount(const std::string& path)
 {
-	m_UncompressedPackageEntries.clear();
+	std::scoped_lock<SpinLock> lock(m_OpenPackageLock);
+
+	auto it = std::find_if(m_Mounts.begin(), m_Mounts.end(), [&](const std::shared_ptr<Package>& pPackage)
+	{
+		return pPackage->mountPath == path;
+	});
+
+	if (it == m_Mounts.end())
+		return false;
+
+	m_Mounts.erase(it);
+	PublishMountIndex();
+	return true;
 }
 
-void Archiver::AddToUncompressedPackage(size_t hash, size_t typeHash, size_t sizeInBytes, void* pData)
+void Archiver::UnmountAll()
 {
-	void* pDataCopy = MemoryManager::GetInstance().Allocate(sizeInBytes, 1, "Uncompressed Package Data");
-	memcpy(pDataCopy, pData, sizeInBytes);
-	m_UncompressedPackageEntries[hash] = UncompressedPackageEntry(typeHash, sizeInBytes, 0, pDataCopy);
+	std::scoped_lock<SpinLock> lock(m_OpenPackageLock);
+
+	m_Mounts.clear();
+	PublishMountIndex();
 }
 
-void Archiver::RemoveFromUncompressedPackage(size_t hash)
+bool Archiver::IsMounted(const std::string& path)
 {
-	m_UncompressedPackageEntries.erase(hash);
+	std::scoped_lock<SpinLock> lock(m_OpenPackageLock);
+	return FindMount(path) != nullptr;
 }
 
-void Archiver::SaveUncompressedPackage(const std::string& filename)
+Archiver::Package* Archiver::FindMount(const std::string& path) const
 {
-#ifdef _DEBUG
-	size_t uncompressedDataSize = 0;
-#endif
+	for (const std::shared_ptr<Package>& pPackage : m_Mounts)
+	{
+		if (pPackage->mountPath == path)
+			return pPackage.get();
+	}
 
-	size_t compressedDataSize = 0;
-	std::stringstream headerTableStream;
-	std::stringstream compressedDataStream;
+	return nullptr;
+}
 
-	for (auto& it : m_UncompressedPackageEntries)
+void Archiver::AddMount(std::shared_ptr<Package> pPackage)
+{
+	//Mounts are kept in priority order, a later mount of the same priority overrides the earlier ones
+	auto it = std::upper_bound(m_Mounts.begin(), m_Mounts.end(), pPackage->priority, [](int32_t priority, const std::shared_ptr<Package>& pMounted)
 	{
-		int err;
-		z_stream compressionStream;
-		compressionStream.zalloc = zalloc;
-		compressionStream.zfree = zfree;
-		compressionStream.opaque = nullptr;
+		return priority < pMounted->priority;
+	});
 
-		err = deflateInit(&compressionStream, COMPRESSION_LEVEL);
-		ARCHIVER_CHECK_ERR(err, "deflateInit");
-		
-		void* pCompressed = MemoryManager::GetInstance().Allocate(it.second.packageEntryDesc.uncompressedSize, 1, "Archiver Compressed Buffer");
-		compressionStream.next_in = reinterpret_cast<Byte*>(it.second.pData);
-		compressionStream.next_out = reinterpret_cast<Byte*>(pCompressed);
-		compressionStream.avail_in = (uInt)it.second.packageEntryDesc.uncompressedSize;
-		compressionStream.avail_out = (uInt)it.second.packageEntryDesc.uncompressedSize;
-
-		err = deflate(&compressionStream, Z_FINISH);
+	m_Mounts.insert(it, std::move(pPackage));
+	PublishMountIndex();
+}
 
-		if (err == Z_OK || err == Z_BUF_ERROR)
-		{
-			//Compressed Size is larger than Uncompressed Size
-			err = deflateEnd(&compressionStream);
-			ARCHIVER_CHECK_ERR(err, "deflateEnd");
+void Archiver::PublishMountIndex()
+{
+	size_t numRecords = 0;
+	for (const std::shared_ptr<Package>& pPackage : m_Mounts)
+		numRecords += pPackage->numRecords;
+
+	std::shared_ptr<MountIndex> pIndex = std::make_shared<MountIndex>();
+	pIndex->mounts = m_Mounts;
+	pIndex->entries.reserve(numRecords);
+	for (const std::shared_ptr<Package>& pPackage : m_Mounts)
+	{
+		for (size_t i = 0; i < pPackage->numRecords; i++)
+			pIndex->entries[pPackage->pRecords[i].hash] = MountedEntry{ pPackage.get(), &pPackage->pRecords[i] };
+	}
 
-			headerTableStream << it.first << std::endl;
-			headerTableStream << it.second.packageEntryDesc.typeHash << std::endl;
-			headerTableStream << compressedDataSize << std::endl;
-			headerTableStream << it.second.packageEntryDesc.uncompressedSize << std::endl;
-			headerTableStream << 0 << std::endl;
+	//The previous index is released outside the lock, it may be the last owner of an unmounted package
+	std::shared_ptr<const MountIndex> pPrevious = std::move(pIndex);
+	{
+		std::scoped_lock<SpinLock> lock(m_MountIndexLock);
+		m_pMountIndex.swap(pPrevious);
+	}
+}
 
-			compressedDataStream.write(reinterpret_cast<char*>(it.second.pData), it.second.packageEntryDesc.uncompressedSize);
+std::shared_ptr<const Archiver::MountIndex> Archiver::GetMountIndex()
+{
+	std::scoped_lock<SpinLock> lock(m_MountIndexLock);
+	return m_pMountIndex;
+}
 
-			compressedDataSize += it.second.packageEntryDesc.uncompressedSize;
-		}
-		else if (err == Z_STREAM_END)
-		{
-			err = deflateEnd(&compressionStream);
-			ARCHIVER_CHECK_ERR(err, "deflateEnd");
+bool Archiver::MapPackage(Package& package)
+{
+#ifdef ARCHIVER_POSIX_IO
+	size_t dataStart = 0;
+	size_t dataSize = 0;
+	{
+		std::ifstream fileStream;
+		fileStream.open(package.filename, std::ios::in | std::ios::binary);
+		if (!fileStream.is_open())
+			return false;
 
-			//if (it.first == HashString("Test String"))
-				//std::cout << "Saved Data: " << reinterpret_cast<char*>(pCompressed) << std::endl;
+		dataSize = ReadPackageHeader(package, fileStream);
+		dataStart = size_t(fileStream.tellg());
+	}
 
-			headerTableStream << it.first << std::endl;
-			headerTableStream << it.second.packageEntryDesc.typeHash << std::endl;
-			headerTableStream << compressedDataSize << std::endl;
-			headerTableStream << it.second.packageEntryDesc.uncompressedSize << std::endl;
-			headerTableStream << compressionStream.total_out << std::endl;
+	int fileDescriptor = open(package.filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fileDescriptor < 0)
+		return false;
 
-			compressedDataStream.write(reinterpret_cast<char*>(pCompressed), compressionStream.total_out);
+	//The mapping stays valid after the descriptor is closed
+	struct stat fileStatus = {};
+	void* pMapping = MAP_FAILED;
+	if (fstat(fileDescriptor, &fileStatus) == 0 && size_t(fileStatus.st_size) >= dataStart + dataSize && fileStatus.st_size > 0)
+		pMapping = mmap(nullptr, size_t(fileStatus.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
 
-			compressedDataSize += compressionStream.total_out;
-		}
+	close(fileDescriptor);
+	if (pMapping == MAP_FAILED)
+		return false;
 
-#ifdef _DEBUG
-		uncompressedDataSize += it.second.packageEntryDesc.uncompressedSize;
+	package.pMapping = pMapping;
+	package.mappingSize = size_t(fileStatus.st_size);
+	package.pData = (char*)pMapping + dataStart;
+	return true;
+#else
+	return false;
 #endif
+}
 
-		MemoryManager::GetInstance().Free(pCompressed);
+bool Archiver::ReadFileAt(int fileDescriptor, void* pBuf, size_t size, size_t position)
+{
+#ifdef ARCHIVER_POSIX_IO
+	//pread may return fewer bytes than asked for, keep going until everything is read
+	char* pDestination = reinterpret_cast<char*>(pBuf);
+	while (size > 0)
+	{
+		ssize_t bytesRead = pread(fileDescriptor, pDestination, size, off_t(position));
+		if (bytesRead < 0 && errno == EINTR)
+			continue;
+
+		if (bytesRead <= 0)
+			return false;
+
+		pDestination += bytesRead;
+		position += size_t(bytesRead);
+		size -= size_t(bytesRead);
 	}
 
-	std::string headerString;
+	return true;
+#else
+	return false;
+#endif
+}
 
-	headerString += std::to_string(m_UncompressedPackageEntries.size()) + "\n";
-	headerString += std::to_string(compressedDataSize) + "\n";
-	headerString += headerTableStream.str();
-	void* pHeader = MemoryManager::GetInstance().Allocate(headerString.length(), 1, "Archiver Package Uncompressed Header");
-	memcpy(pHeader, headerString.c_str(), headerString.length());
+void Archiver::CloseFile(int fileDescriptor)
+{
+#ifdef ARCHIVER_POSIX_IO
+	close(fileDescriptor);
+#endif
+}
 
-	size_t compressedHeaderMaxSize = headerString.length() + 4; //4 bytes extra for potential zlib header.
-	void* pCompressedHeader = MemoryManager::GetInstance().Allocate(compressedHeaderMaxSize, 1, "Archiver Package Compressed Header");
-	size_t compressedHeaderSize = CompressHeader(pHeader, headerString.length(), pCompressedHeader, compressedHeaderMaxSize);
+void Archiver::UnmapFile(void* pMapping, size_t size)
+{
+#ifdef ARCHIVER_POSIX_IO
+	munmap(pMapping, size);
+#endif
+}
 
-	std::ofstream file;
-	file.open(filename + PACKAGE_FILE_EXTENSION, std::ios::out | std::ios::trunc | std::ios::binary);
+template<typename Func>
+bool Archiver::AccessLooseEntry(Package& package, const PackageRecord* pRecord, bool isDataNeeded, Func func)
+{
+	//Imports can take a while, so they hold the lock of their own directory instead of a SpinLock
+	std::scoped_lock<std::mutex> lock(package.importLock);
 
-	file << compressedHeaderSize << std::endl;
-	file << headerString.length() << std::endl;
-	file.write(reinterpret_cast<char*>(pCompressedHeader), compressedHeaderSize);
-	file << compressedDataStream.str();
+	LooseEntry& entry = package.looseEntries[pRecord - package.pRecords];
+	if (!entry.isImported || (isDataNeeded && entry.pData == nullptr))
+	{
+		std::string path = package.filename + std::string(package.pStrings + pRecord->nameOffset, pRecord->nameLength);
+		size_t size = 0;
+		std::vector<size_t> dependencies;
+		void* pData = package.importer(pRecord->hash, path, size, dependencies);
+		if (!pData)
+		{
+			ThreadSafePrintf("Failed to import [%s]!\n", path.c_str());
+			return false;
+		}
 
-	file.close();
+		if (entry.pData != nullptr)
+			MemoryManager::GetInstance().Free(entry.pData);
 
-	MemoryManager::GetInstance().Free(pHeader);
-	MemoryManager::GetInstance().Free(pCompressedHeader);
+		entry.pData = pData;
+		entry.size = size;
+		entry.dependencies = std::move(dependencies);
+		entry.isImported = true;
+	}
 
-#ifdef _DEBUG
-	std::cout << std::endl << "Compressed Package: " << std::endl;
-	std::cout << "Uncompressed Size: " << (uncompressedDataSize + headerString.length()) << " bytes" << std::endl;
-	std::cout << "Compressed Size: " << (compressedDataSize + compressedHeaderSize) << " bytes" << std::endl;
-	std::cout << "Compressed Relative Size: " << (100.0f * (float)(compressedDataSize + compressedHeaderSize) / (uncompressedDataSize + headerString.length())) << "%" << std::endl << std::endl;
-#endif
+	return func(entry);
 }
 
-void Archiver::CloseUncompressedPackage()
+size_t Archiver::ReadRequiredSizeForPackageData(size_t hash)
 {
-	for (auto& it : m_UncompressedPackageEntries)
+	std::shared_ptr<const MountIndex> pIndex = GetMountIndex();
+	const MountedEntry* pEntry = pIndex->Find(hash);
+	if (!pEntry)
+		return 0;
+
+	if (pEntry->pPackage->packageMode == MOUNT_DIRECTORY)
 	{
-		if (it.second.pData != nullptr)
+		size_t size = 0;
+		AccessLooseEntry(*pEntry->pPackage, pEntry->pRecord, false, [&](LooseEntry& entry)
 		{
-			MemoryManager::GetInstance().Free(it.second.pData);
-			it.second.pData = nullptr;
-		}
+			size = entry.size;
+			return true;
+		});
+		return size;
 	}
 
-	m_UncompressedPackageEntries.clear();
+	return pEntry->pRecord->uncompressedSize;
 }
 
-void* Archiver::DecompressHeader(std::ifstream& fileStream)
+bool Archiver::ReadPackageData(size_t hash, size_t& typeHash, void* pBuf, size_t bufSize)
 {
-	size_t headerCompressedSize;
-	size_t headerUncompressedSize;
+	RecordAccess(hash);
 
-	fileStream >> headerCompressedSize;
-	fileStream >> headerUncompressedSize;
+	std::shared_ptr<const MountIndex> pIndex = GetMountIndex();
+	const MountedEntry* pEntry = pIndex->Find(hash);
+	if (!pEntry)
+		return false;
 
-	void* pCompressedHeader = MemoryManager::GetInstance().Allocate(headerCompressedSize, 1, "Archiver Package Compressed Header");
-	void* pDecompressedHeader = MemoryManager::GetInstance().Allocate(headerUncompressedSize, 1, "Archiver Package Uncompressed Header");
-	fileStream.seekg(1, std::ios_base::cur);
-	fileStream.read(reinterpret_cast<char*>(pCompressedHeader), headerCompressedSize);
+	return ReadPackageData(*pEntry->pPackage, pEntry->pRecord, typeHash, pBuf, bufSize);
+}
 
-	int err;
-	z_stream decompressionStream;
-	decompressionStream.zalloc = zalloc;
-	decompressionStream.zfree = zfree;
-	decompressionStream.opaque = nullptr;
+bool Archiver::ReadPackageData(Package& package, const PackageRecord* pRecord, size_t& typeHash, void* pBuf, size_t bufSize)
+{
+	if (package.packageMode == MOUNT_DIRECTORY)
+	{
+		typeHash = pRecord->typeHash;
 
-	err = inflateInit(&decompressionStream);
-	ARCHIVER_CHECK_ERR(err, "inflateInit");
+		//The import is only kept around for the read that usually follows the size query
+		return AccessLooseEntry(package, pRecord, true, [&](LooseEntry& entry)
+		{
+			if (bufSize < entry.size)
+				return false;
+
+			memcpy(pBuf, entry.pData, entry.size);
+			MemoryManager::GetInstance().Free(entry.pData);
+			entry.pData = nullptr;
+			return true;
+		});
+	}
 
-	decompressionStream.next_in = reinterpret_cast<Byte*>(pCompressedHeader);
-	decompressionStream.next_out = reinterpret_cast<Byte*>(pDecompressedHeader);
-	decompressionStream.avail_in = (uInt)headerCompressedSize;
-	decompressionStream.avail_out = (uInt)headerUncompressedSize;
+	if (bufSize < pRecord->uncompressedSize)
+		return false;
 
-	err = inflate(&decompressionStream, Z_FINISH);
-	assert(err > Z_OK);
+	typeHash = pRecord->typeHash;
+	void* pCompressedStart = nullptr;
 
-	err = inflateEnd(&decompressionStream);
-	ARCHIVER_CHECK_ERR(err, "inflateEnd");
+	switch (package.packageMode)
+	{
+		//Both keep the data section addressable, so reading needs no locks
+		case LOAD_AND_STORE:
+		case LOAD_MAPPED:
+		{
+			if (pRecord->compressedSize > 0)
+			{
+				pCompressedStart = reinterpret_cast<void*>((size_t)package.pData + pRecord->offset);
+			}
+			else
+			{
+				memcpy(pBuf, (void*)((size_t)package.pData + pRecord->offset), pRecord->uncompressedSize);
+				return true;
+			}
+			break;
+		}
+		case LOAD_AND_PREPARE:
+		{
+			assert(package.pFileStream != nullptr);
+
+			//Very large entries are decoded in windows instead of reading all of their compressed data next to the output,
+			//which gives up decompressing the blocks in parallel
+			if (pRecord->compressedSize > PACKAGE_STREAM_THRESHOLD)
+			{
+				size_t decodedSize = 0;
+				bool isRead = ReadPackageDataStreamed(package, pRecord, [&](const void* pData, size_t size)
+				{
+					if (decodedSize + size > bufSize)
+						return false;
+
+					memcpy(reinterpret_cast<char*>(pBuf) + decodedSize, pData, size);
+					decodedSize += size;
+					return true;
+				});
+
+				return isRead && decodedSize == pRecord->uncompressedSize;
+			}
+
+			if (package.fileDescriptor >= 0)
+			{
+				size_t position = package.fileDataStart + pRecord->offset;
+				if (pRecord->compressedSize == 0)
+					return ReadFileAt(package.fileDescriptor, pBuf, pRecord->uncompressedSize, position);
+
+				pCompressedStart = MemoryManager::GetInstance().Allocate(pRecord->compressedSize, 1, "Package Data");
+				if (!ReadFileAt(package.fileDescriptor, pCompressedStart, pRecord->compressedSize, position))
+				{
+					MemoryManager::GetInstance().Free(pCompressedStart);
+					return false;
+				}
+
+				break;
+			}
+
+			{
+				std::scoped_lock<SpinLock> lock(m_FileStreamLock);
+
+				std::ifstream& fileStream = *package.pFileStream;
+				if (package.pFileStream->is_open())
+				{
+					fileStream.seekg(package.fileDataStart + pRecord->offset, std::ios_base::beg);
+
+					if (pRecord->compressedSize > 0)
+					{
+						pCompressedStart = MemoryManager::GetInstance().Allocate(pRecord->compressedSize, 1, "Package Data");
+						fileStream.read(reinterpret_cast<char*>(pCompressedStart), pRecord->compressedSize);
+					}
+					else
+					{
+						fileStream.read(reinterpret_cast<char*>(pBuf), pRecord->uncompressedSize);
+						return true;
+					}
+				}
+			}
+
+			break;
+		}
+		default:
+		{
+			assert(false);
+			break;
+		}
+	}
+
+	bool isDecompressed = DecompressRecord(package, pRecord, pCompressedStart, pBuf);
+
+	if (package.packageMode == LOAD_AND_PREPARE)
+		MemoryManager::GetInstance().Free(pCompressedStart);
+
+	return isDecompressed;
+}
+
+bool Archiver::ReadPackageDataPrefix(size_t hash, size_t& typeHash, void* pBuf, size_t size)
+{
+	RecordAccess(hash);
+
+	std::shared_ptr<const MountIndex> pIndex = GetMountIndex();
+	const MountedEntry* pEntry = pIndex->Find(hash);
+	if (!pEntry)
+		return false;
+
+	Package& package = *pEntry->pPackage;
+	const PackageRecord* pRecord = pEntry->pRecord;
+	typeHash = pRecord->typeHash;
+	if (package.packageMode == MOUNT_DIRECTORY)
+	{
+		return AccessLooseEntry(package, pRecord, true, [&](LooseEntry& entry)
+		{
+			if (size > entry.size)
+				return false;
+
+			memcpy(pBuf, entry.pData, size);
+			return true;
+		});
+	}
+
+	if (size > pRecord->uncompressedSize)
+		return false;
+
+	if (pRecord->compressedSize == 0)
+		return ReadStoredData(package, pRecord, 0, pBuf, size);
+
+	//Prefixes are meant for headers, one that reaches past the first block simply decompresses the whole entry
+	size_t storedSize = pRecord->compressedSize;
+	size_t blockSize = package.blockSize;
+	if (pRecord->uncompressedSize > blockSize && size > blockSize)
+	{
+		void* pEntryData = MemoryManager::GetInstance().Allocate(pRecord->uncompressedSize, 1, "Package Data Prefix");
+		bool isRead = ReadPackageData(package, pRecord, typeHash, pEntryData, pRecord->uncompressedSize);
+		if (isRead)
+			memcpy(pBuf, pEntryData, size);
+
+		MemoryManager::GetInstance().Free(pEntryData);
+		return isRead;
+	}
+
+	if (pRecord->uncompressedSize > blockSize)
+	{
+		if (pRecord->firstBlock >= package.numBlocks)
+			return false;
+
+		storedSize = package.pBlocks[pRecord->firstBlock];
+		if (storedSize == blockSize)
+			return ReadStoredData(package, pRecord, 0, pBuf, size);
+	}
+
+	const void* pDictionary = nullptr;
+	size_t dictionarySize = 0;
+	if (!GetRecordDictionary(package, pRecord, pDictionary, dictionarySize))
+		return false;
+
+	//A short prefix rarely needs more than the start of the stream, the whole block is only read if it does
+	PackageCodec codec = PackageCodec(pRecord->codec);
+	size_t readSize = std::min(storedSize, size_t(PACKAGE_PREFIX_READ_SIZE));
+	for (;;)
+	{
+		void* pCompressed = MemoryManager::GetInstance().Allocate(readSize, 1, "Package Data Prefix");
+		bool isRead = ReadStoredData(package, pRecord, 0, pCompressed, readSize);
+		if (isRead)
+		{
+			if (codec == CODEC_LZ4)
+				isRead = Lz4::DecompressPrefix(pCompressed, readSize, pBuf, size);
+			else
+				isRead = InflateEntry(pCompressed, readSize, pBuf, size, pDictionary, dictionarySize, true);
+		}
+
+		MemoryManager::GetInstance().Free(pCompressed);
+		if (isRead || readSize == storedSize)
+			return isRead;
+
+		readSize = storedSize;
+	}
+}
+
+bool Archiver::ReadStoredData(Package& package, const PackageRecord* pRecord, size_t offset, void* pBuf, size_t size)
+{
+	switch (package.packageMode)
+	{
+		case LOAD_AND_STORE:
+		case LOAD_MAPPED:
+		{
+			memcpy(pBuf, GetStoredData(package, pRecord) + offset, size);
+			return true;
+		}
+		case LOAD_AND_PREPARE:
+		{
+			size_t position = package.fileDataStart + pRecord->offset + offset;
+			if (package.fileDescriptor >= 0)
+				return ReadFileAt(package.fileDescriptor, pBuf, size, position);
+
+			std::scoped_lock<SpinLock> lock(m_FileStreamLock);
+			std::ifstream& fileStream = *package.pFileStream;
+			fileStream.seekg(position, std::ios_base::beg);
+			fileStream.read(reinterpret_cast<char*>(pBuf), size);
+			return fileStream.good();
+		}
+		default:
+		{
+			assert(false);
+			return false;
+		}
+	}
+}
+
+bool Archiver::ReadPackageDataStreamed(size_t hash, size_t& typeHash, const PackageSink& sink)
+{
+	RecordAccess(hash);
+
+	std::shared_ptr<const MountIndex> pIndex = GetMountIndex();
+	const MountedEntry* pEntry = pIndex->Find(hash);
+	if (!pEntry)
+		return false;
+
+	typeHash = pEntry->pRecord->typeHash;
+	return ReadPackageDataStreamed(*pEntry->pPackage, pEntry->pRecord, sink);
+}
+
+bool Archiver::ReadPackageDataStreamed(Package& package, const PackageRecord* pRecord, const PackageSink& sink)
+{
+	if (package.packageMode == MOUNT_DIRECTORY)
+	{
+		//Imports are whole files already, they are only handed out in windows
+		return AccessLooseEntry(package, pRecord, true, [&](LooseEntry& entry)
+		{
+			bool isRead = true;
+			for (size_t offset = 0; isRead && offset < entry.size; offset += PACKAGE_STREAM_WINDOW_SIZE)
+				isRead = sink(reinterpret_cast<const char*>(entry.pData) + offset, std::min(size_t(PACKAGE_STREAM_WINDOW_SIZE), entry.size - offset));
+
+			MemoryManager::GetInstance().Free(entry.pData);
+			entry.pData = nullptr;
+			return isRead;
+		});
+	}
+
+	if (pRecord->compressedSize == 0)
+	{
+		void* pWindow = MemoryManager::GetInstance().Allocate(PACKAGE_STREAM_WINDOW_SIZE, 1, "Package Stream Window");
+		bool isRead = StreamStoredData(package, pRecord, 0, pRecord->uncompressedSize, pWindow, sink);
+		MemoryManager::GetInstance().Free(pWindow);
+		return isRead;
+	}
+
+	size_t blockSize = package.blockSize;
+	if (pRecord->uncompressedSize <= blockSize)
+		return StreamDecode(package, pRecord, 0, pRecord->compressedSize, pRecord->uncompressedSize, sink);
+
+	size_t blockCount = (pRecord->uncompressedSize + blockSize - 1) / blockSize;
+	if (pRecord->firstBlock + blockCount > package.numBlocks)
+		return false;
+
+	//The sink cannot take data back, so the block index is checked before anything is decoded
+	const uint32_t* pBlockSizes = package.pBlocks + pRecord->firstBlock;
+	size_t storedSize = 0;
+	for (size_t block = 0; block < blockCount; block++)
+		storedSize += pBlockSizes[block];
+
+	if (storedSize != pRecord->compressedSize)
+		return false;
+
+	size_t offset = 0;
+	for (size_t block = 0; block < blockCount; block++)
+	{
+		size_t size = std::min(blockSize, size_t(pRecord->uncompressedSize) - block * blockSize);
+		bool isRead = false;
+		if (pBlockSizes[block] == size)
+		{
+			void* pWindow = MemoryManager::GetInstance().Allocate(PACKAGE_STREAM_WINDOW_SIZE, 1, "Package Stream Window");
+			isRead = StreamStoredData(package, pRecord, offset, size, pWindow, sink);
+			MemoryManager::GetInstance().Free(pWindow);
+		}
+		else
+		{
+			isRead = StreamDecode(package, pRecord, offset, pBlockSizes[block], size, sink);
+		}
+
+		if (!isRead)
+			return false;
+
+		offset += pBlockSizes[block];
+	}
+
+	return true;
+}
+
+const char* Archiver::GetStoredData(const Package& package, const PackageRecord* pRecord)
+{
+	//Both keep the data section addressable
+	if (package.packageMode == LOAD_AND_STORE || package.packageMode == LOAD_MAPPED)
+		return reinterpret_cast<const char*>(package.pData) + pRecord->offset;
+
+	return nullptr;
+}
+
+bool Archiver::StreamStoredData(Package& package, const PackageRecord* pRecord, size_t offset, size_t size, void* pWindow, const PackageSink& consume)
+{
+	const char* pStored = GetStoredData(package, pRecord);
+	for (size_t position = 0; position < size; position += PACKAGE_STREAM_WINDOW_SIZE)
+	{
+		size_t windowSize = std::min(size_t(PACKAGE_STREAM_WINDOW_SIZE), size - position);
+		const void* pData = pStored ? pStored + offset + position : pWindow;
+		if (!pStored && !ReadStoredData(package, pRecord, offset + position, pWindow, windowSize))
+			return false;
+
+		if (!consume(pData, windowSize))
+			return false;
+	}
+
+	return true;
+}
+
+bool Archiver::StreamDecode(Package& package, const PackageRecord* pRecord, size_t offset, size_t storedSize, size_t size, const PackageSink& sink)
+{
+	const void* pDictionary = nullptr;
+	size_t dictionarySize = 0;
+	if (!GetRecordDictionary(package, pRecord, pDictionary, dictionarySize))
+		return false;
+
+	PackageCodec codec = PackageCodec(pRecord->codec);
+	if (codec == CODEC_LZ4)
+	{
+		//LZ4 matches can reach back into anything decoded before them, so a block is decoded whole
+		const char* pStored = GetStoredData(package, pRecord);
+		void* pCompressed = pStored ? nullptr : MemoryManager::GetInstance().Allocate(storedSize, 1, "Package Stream Block");
+		void* pDecoded = MemoryManager::GetInstance().Allocate(size, 1, "Package Stream Block");
+		bool isRead = pStored || ReadStoredData(package, pRecord, offset, pCompressed, storedSize);
+		isRead = isRead && Lz4::Decompress(pStored ? pStored + offset : pCompressed, storedSize, pDecoded, size);
+		isRead = isRead && sink(pDecoded, size);
+
+		if (pCompressed)
+			MemoryManager::GetInstance().Free(pCompressed);
+
+		MemoryManager::GetInstance().Free(pDecoded);
+		return isRead;
+	}
+
+	if (codec != CODEC_DEFLATE && codec != CODEC_DEFLATE_DICTIONARY)
+	{
+		ThreadSafePrintf("Unknown package codec %u!\n", unsigned(codec));
+		return false;
+	}
+
+	int err;
+	z_stream decompressionStream;
+	decompressionStream.zalloc = zalloc;
+	decompressionStream.zfree = zfree;
+	decompressionStream.opaque = nullptr;
+	decompressionStream.next_in = Z_NULL;
+	decompressionStream.avail_in = 0;
+
+	err = inflateInit(&decompressionStream);
+	ARCHIVER_CHECK_ERR(err, "inflateInit");
+
+	//One window holds the compressed input and the other the output that is handed to the sink
+	char* pWindows = reinterpret_cast<char*>(MemoryManager::GetInstance().Allocate(2 * PACKAGE_STREAM_WINDOW_SIZE, 1, "Package Stream Window"));
+	char* pOutput = pWindows + PACKAGE_STREAM_WINDOW_SIZE;
+	size_t decodedSize = 0;
+	bool isEnd = false;
+	bool isRead = StreamStoredData(package, pRecord, offset, storedSize, pWindows, [&](const void* pData, size_t dataSize)
+	{
+		if (isEnd)
+			return false;
+
+		decompressionStream.next_in = reinterpret_cast<Byte*>(const_cast<void*>(pData));
+		decompressionStream.avail_in = (uInt)dataSize;
+		for (;;)
+		{
+			decompressionStream.next_out = reinterpret_cast<Byte*>(pOutput);
+			decompressionStream.avail_out = (uInt)PACKAGE_STREAM_WINDOW_SIZE;
+			err = inflate(&decompressionStream, Z_NO_FLUSH);
+
+			//Streams written with a preset dictionary stop right after the header until it is set
+			if (err == Z_NEED_DICT)
+			{
+				if (!pDictionary || inflateSetDictionary(&decompressionStream, reinterpret_cast<const Bytef*>(pDictionary), (uInt)dictionarySize) != Z_OK)
+					return false;
+
+				continue;
+			}
+
+			if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
+				return false;
+
+			size_t producedSize = PACKAGE_STREAM_WINDOW_SIZE - decompressionStream.avail_out;
+			decodedSize += producedSize;
+			if (decodedSize > size || (producedSize > 0 && !sink(pOutput, producedSize)))
+				return false;
+
+			if (err == Z_STREAM_END)
+			{
+				isEnd = true;
+				return true;
+			}
+
+			//A full output window may leave more output pending, otherwise the stream needs the next input window
+			if (decompressionStream.avail_in == 0 && decompressionStream.avail_out > 0)
+				return true;
+
+			if (err == Z_BUF_ERROR)
+				return false;
+		}
+	});
+
+	inflateEnd(&decompressionStream);
+	MemoryManager::GetInstance().Free(pWindows);
+
+	return isRead && isEnd && decodedSize == size;
+}
+
+bool Archiver::GetRecordDictionary(Package& package, const PackageRecord* pRecord, const void*& pDictionary, size_t& dictionarySize)
+{
+	pDictionary = nullptr;
+	dictionarySize = 0;
+	if (pRecord->dictionaryHash == 0)
+		return true;
+
+	pDictionary = GetDictionary(package, pRecord->dictionaryHash, dictionarySize);
+	return pDictionary != nullptr;
+}
+
+bool Archiver::DecompressRecord(Package& package, const PackageRecord* pRecord, const void* pCompressed, void* pBuf)
+{
+	const void* pDictionary = nullptr;
+	size_t dictionarySize = 0;
+	if (!GetRecordDictionary(package, pRecord, pDictionary, dictionarySize))
+		return false;
+
+	PackageCodec codec = PackageCodec(pRecord->codec);
+	size_t blockSize = package.blockSize;
+	if (pRecord->uncompressedSize <= blockSize)
+		return DecompressData(codec, pCompressed, pRecord->compressedSize, pBuf, pRecord->uncompressedSize, pDictionary, dictionarySize);
+
+	size_t blockCount = (pRecord->uncompressedSize + blockSize - 1) / blockSize;
+	if (pRecord->firstBlock + blockCount > package.numBlocks)
+		return false;
+
+	const uint32_t* pBlockSizes = package.pBlocks + pRecord->firstBlock;
+	std::vector<size_t> blockOffsets(blockCount + 1, 0);
+	for (size_t block = 0; block < blockCount; block++)
+		blockOffsets[block + 1] = blockOffsets[block] + pBlockSizes[block];
+
+	if (blockOffsets[blockCount] != pRecord->compressedSize)
+		return false;
+
+	//Blocks are independent, so all workers decompress them straight into their place in the buffer
+	std::atomic<bool> isValid = true;
+	TaskManager::Get().ParallelFor(0, blockCount, 1, [&](size_t block)
+	{
+		size_t offset = block * blockSize;
+		size_t size = std::min(blockSize, size_t(pRecord->uncompressedSize) - offset);
+		const char* pBlock = reinterpret_cast<const char*>(pCompressed) + blockOffsets[block];
+		char* pDestination = reinterpret_cast<char*>(pBuf) + offset;
+
+		if (pBlockSizes[block] == size)
+			memcpy(pDestination, pBlock, size);
+		else if (!DecompressData(codec, pBlock, pBlockSizes[block], pDestination, size, pDictionary, dictionarySize))
+			isValid.store(false, std::memory_order_relaxed);
+	});
+
+	return isValid;
+}
+
+const void* Archiver::GetDictionary(Package& package, uint64_t hash, size_t& size)
+{
+	//Every package trains its own dictionaries, so they are never looked up in the other mounts
+	const PackageRecord* pRecord = FindPackageRecord(package, hash);
+	if (!pRecord)
+		return nullptr;
+
+	size = pRecord->uncompressedSize;
+	{
+		std::scoped_lock<SpinLock> lock(m_DictionaryLock);
+		auto it = package.dictionaries.find(hash);
+		if (it != package.dictionaries.end())
+			return it->second;
+	}
+
+	//Dictionaries are stored without compression, so this never needs another dictionary
+	size_t typeHash = 0;
+	void* pDictionary = MemoryManager::GetInstance().Allocate(size, 1, "Package Dictionary");
+	if (!ReadPackageData(package, pRecord, typeHash, pDictionary, size))
+	{
+		MemoryManager::GetInstance().Free(pDictionary);
+		return nullptr;
+	}
+
+	//Another reader may have loaded it in the meantime
+	std::scoped_lock<SpinLock> lock(m_DictionaryLock);
+	auto it = package.dictionaries.emplace(hash, pDictionary);
+	if (!it.second)
+		MemoryManager::GetInstance().Free(pDictionary);
+
+	return it.first->second;
+}
+
+size_t Archiver::CompressData(PackageCodec codec, const void* pData, size_t size, void* pBuf, size_t bufSize, const void* pDictionary, size_t dictionarySize)
+{
+	switch (codec)
+	{
+		case CODEC_DEFLATE:
+			return DeflateEntry(pData, size, pBuf, bufSize, COMPRESSION_LEVEL, nullptr, 0);
+		case CODEC_LZ4:
+			return Lz4::Compress(pData, size, pBuf, bufSize);
+		case CODEC_DEFLATE_DICTIONARY:
+			return DeflateEntry(pData, size, pBuf, bufSize, DICTIONARY_COMPRESSION_LEVEL, pDictionary, dictionarySize);
+		default:
+			return 0;
+	}
+}
+
+bool Archiver::DecompressData(PackageCodec codec, const void* pCompressed, size_t compressedSize, void* pBuf, size_t uncompressedSize, const void* pDictionary, size_t dictionarySize)
+{
+	switch (codec)
+	{
+		case CODEC_DEFLATE:
+		case CODEC_DEFLATE_DICTIONARY:
+			return InflateEntry(pCompressed, compressedSize, pBuf, uncompressedSize, pDictionary, dictionarySize, false);
+		case CODEC_LZ4:
+			return Lz4::Decompress(pCompressed, compressedSize, pBuf, uncompressedSize);
+		default:
+		{
+			ThreadSafePrintf("Unknown package codec %u!\n", unsigned(codec));
+			return false;
+		}
+	}
+}
+
+bool Archiver::InflateEntry(const void* pCompressed, size_t compressedSize, void* pBuf, size_t uncompressedSize, const void* pDictionary, size_t dictionarySize, bool isPrefix)
+{
+	int err;
+	z_stream decompressionStream;
+	decompressionStream.zalloc = zalloc;
+	decompressionStream.zfree = zfree;
+	decompressionStream.opaque = nullptr;
+
+	err = inflateInit(&decompressionStream);
+	ARCHIVER_CHECK_ERR(err, "inflateInit");
+
+	//std::cout << "Loaded Data: " << reinterpret_cast<char*>(pCompressedStart) << std::endl;
+
+	decompressionStream.next_in = reinterpret_cast<Byte*>(const_cast<void*>(pCompressed));
+	decompressionStream.next_out = reinterpret_cast<Byte*>(pBuf);
+	decompressionStream.avail_in = (uInt)compressedSize;
+	decompressionStream.avail_out = (uInt)uncompressedSize;
+
+	//A prefix only has to fill the output, the input may be cut off anywhere after that
+	int flush = isPrefix ? Z_SYNC_FLUSH : Z_FINISH;
+	err = inflate(&decompressionStream, flush);
+
+	//Streams written with a preset dictionary stop right after the header until it is set
+	if (err == Z_NEED_DICT && pDictionary != nullptr)
+	{
+		err = inflateSetDictionary(&decompressionStream, reinterpret_cast<const Bytef*>(pDictionary), (uInt)dictionarySize);
+		ARCHIVER_CHECK_ERR(err, "inflateSetDictionary");
+		err = inflate(&decompressionStream, flush);
+	}
+
+	bool isInflated = isPrefix ? decompressionStream.avail_out == 0 : err == Z_STREAM_END;
+	assert(isPrefix || isInflated);
+
+	err = inflateEnd(&decompressionStream);
+	ARCHIVER_CHECK_ERR(err, "inflateEnd");
+
+	return isInflated;
+}
+
+bool Archiver::GetPackageDataView(size_t hash, size_t& typeHash, const void*& pData, size_t& size)
+{
+	RecordAccess(hash);
+
+	std::shared_ptr<const MountIndex> pIndex = GetMountIndex();
+	const MountedEntry* pEntry = pIndex->Find(hash);
+	if (!pEntry || pEntry->pPackage->packageMode != LOAD_MAPPED || pEntry->pRecord->compressedSize > 0)
+		return false;
+
+	typeHash = pEntry->pRecord->typeHash;
+	pData = (const char*)pEntry->pPackage->pData + pEntry->pRecord->offset;
+	size = pEntry->pRecord->uncompressedSize;
+	return true;
+}
+
+Archiver::PackageMode Archiver::GetPackageMode(const std::string& path)
+{
+	std::scoped_lock<SpinLock> lock(m_OpenPackageLock);
+
+	Package* pPackage = FindMount(path);
+	return pPackage ? pPackage->packageMode : UNDEFINED;
+}
+
+AsyncTask<bool> Archiver::ReadPackageDataAsync(size_t hash, size_t& typeHash, void* pBuf, size_t bufSize)
+{
+	PackageRead read = { hash, pBuf, bufSize, 0, false };
+	co_await ReadPackageDataBatchAsync(&read, 1);
+
+	if (read.isRead)
+		typeHash = read.typeHash;
+
+	co_return read.isRead;
+}
+
+void Archiver::QueueBatch(PackageRead* pReads, size_t count, std::coroutine_handle<> handle)
+{
+	{
+		std::scoped_lock<std::mutex> lock(m_IoQueueLock);
+		if (!m_IoThread.joinable())
+			m_IoThread = std::thread(&Archiver::IoThread, this);
+
+		m_IoQueue.push({ pReads, count, handle });
+	}
+
+	m_IoQueueCondition.notify_one();
+}
+
+void Archiver::IoThread()
+{
+	while (true)
+	{
+		QueuedBatch batch;
+		{
+			std::unique_lock<std::mutex> lock(m_IoQueueLock);
+			m_IoQueueCondition.wait(lock, [this] { return m_IsIoThreadStopping || !m_IoQueue.empty(); });
+			if (m_IoQueue.empty())
+				return;
+
+			batch = m_IoQueue.front();
+			m_IoQueue.pop();
+		}
+
+		//The batch blocks this thread on the disk instead of a worker, it only helps with the queue while its decompressions
+		//and the reads of other package modes finish
+		ReadPackageDataBatch(batch.pReads, batch.count);
+
+		std::coroutine_handle<> handle = batch.handle;
+		TaskManager::Get().Execute([handle] { handle.resume(); }, TaskManager::PRIORITY_BACKGROUND, "ReadPackageDataBatch resume");
+	}
+}
+
+void Archiver::ReadPackageDataBatch(PackageRead* pReads, size_t count)
+{
+	//Entries of prepared packages are read from the file in spans, every other mount and the entries that are too large
+	//to read at once are read by the workers
+	std::shared_ptr<const MountIndex> pIndex = GetMountIndex();
+	std::vector<size_t> fileReads;
+	std::vector<size_t> workerReads;
+	for (size_t i = 0; i < count; i++)
+	{
+		PackageRead& read = pReads[i];
+		read.isRead = false;
+		RecordAccess(read.hash);
+
+		const MountedEntry* pEntry = pIndex->Find(read.hash);
+		bool isStreamed = pEntry && pEntry->pRecord->compressedSize > PACKAGE_STREAM_THRESHOLD;
+		if (pEntry && pEntry->pPackage->packageMode == LOAD_AND_PREPARE && pEntry->pPackage->fileDescriptor >= 0 && !isStreamed)
+		{
+			if (read.bufSize < pEntry->pRecord->uncompressedSize)
+				continue;
+
+			read.typeHash = pEntry->pRecord->typeHash;
+			fileReads.push_back(i);
+		}
+		else
+		{
+			workerReads.push_back(i);
+		}
+	}
+
+	std::vector<PackageSpan> spans;
+	PlanPackageSpans(*pIndex, pReads, fileReads, spans);
+	if (!spans.empty())
+	{
+		std::vector<size_t> unreadSpans;
+		ReadPackageSpansIoUring(*pIndex, pReads, fileReads, spans, unreadSpans);
+
+		TaskManager::Get().ParallelFor(0, unreadSpans.size(), 1, [&](size_t i)
+		{
+			ReadPackageSpan(*pIndex, pReads, fileReads, spans[unreadSpans[i]]);
+		});
+	}
+
+	//pread and the mapped modes need no locks, so one task per entry keeps as many reads in flight as there are workers
+	TaskManager::Get().ParallelFor(0, workerReads.size(), 1, [&](size_t i)
+	{
+		PackageRead& read = pReads[workerReads[i]];
+		const MountedEntry* pEntry = pIndex->Find(read.hash);
+		read.isRead = pEntry && ReadPackageData(*pEntry->pPackage, pEntry->pRecord, read.typeHash, read.pBuf, read.bufSize);
+	});
+}
+
+void Archiver::PlanPackageSpans(const MountIndex& index, PackageRead* pReads, std::vector<size_t>& readIndices, std::vector<PackageSpan>& spans)
+{
+	std::vector<const MountedEntry*> entries(readIndices.size());
+	for (size_t i = 0; i < readIndices.size(); i++)
+		entries[i] = index.Find(pReads[readIndices[i]].hash);
+
+	//Sorting by position turns entries that were written next to each other into neighbours
+	std::vector<size_t> order(readIndices.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+
+	std::sort(order.begin(), order.end(), [&](size_t first, size_t second)
+	{
+		if (entries[first]->pPackage != entries[second]->pPackage)
+			return entries[first]->pPackage < entries[second]->pPackage;
+
+		return entries[first]->pRecord->offset < entries[second]->pRecord->offset;
+	});
+
+	std::vector<size_t> sortedIndices(readIndices.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const MountedEntry* pEntry = entries[order[i]];
+		const PackageRecord* pRecord = pEntry->pRecord;
+		size_t position = pEntry->pPackage->fileDataStart + pRecord->offset;
+		size_t end = position + (pRecord->compressedSize > 0 ? pRecord->compressedSize : pRecord->uncompressedSize);
+		sortedIndices[i] = readIndices[order[i]];
+
+		if (!spans.empty())
+		{
+			PackageSpan& span = spans.back();
+			size_t spanEnd = std::max(span.position + span.size, end);
+			if (span.pPackage == pEntry->pPackage && position <= span.position + span.size + PACKAGE_COALESCE_GAP && spanEnd - span.position <= PACKAGE_COALESCE_SIZE)
+			{
+				span.size = spanEnd - span.position;
+				span.readCount++;
+				continue;
+			}
+		}
+
+		spans.push_back({ pEntry->pPackage, position, end - position, i, 1 });
+	}
+
+	readIndices = std::move(sortedIndices);
+}
+
+void Archiver::ReadPackageSpan(const MountIndex& index, PackageRead* pReads, const std::vector<size_t>& readIndices, const PackageSpan& span)
+{
+	if (span.readCount == 1)
+	{
+		PackageRead& read = pReads[readIndices[span.firstRead]];
+		read.isRead = ReadPackageData(*span.pPackage, index.Find(read.hash)->pRecord, read.typeHash, read.pBuf, read.bufSize);
+		return;
+	}
+
+	void* pSpanData = MemoryManager::GetInstance().Allocate(span.size, 1, "Package Span");
+	if (ReadFileAt(span.pPackage->fileDescriptor, pSpanData, span.size, span.position))
+		FinishPackageSpan(index, pReads, readIndices, span, pSpanData);
+
+	MemoryManager::GetInstance().Free(pSpanData);
+}
+
+void Archiver::FinishPackageSpan(const MountIndex& index, PackageRead* pReads, const std::vector<size_t>& readIndices, const PackageSpan& span, const void* pSpanData)
+{
+	TaskManager::Get().ParallelFor(span.firstRead, span.firstRead + span.readCount, 1, [&](size_t i)
+	{
+		PackageRead& read = pReads[readIndices[i]];
+		const PackageRecord* pRecord = index.Find(read.hash)->pRecord;
+		const char* pStored = reinterpret_cast<const char*>(pSpanData) + (span.pPackage->fileDataStart + pRecord->offset - span.position);
+		if (pRecord->compressedSize == 0)
+		{
+			memcpy(read.pBuf, pStored, pRecord->uncompressedSize);
+			read.isRead = true;
+			return;
+		}
+
+		read.isRead = DecompressRecord(*span.pPackage, pRecord, pStored, read.pBuf);
+	});
+}
+
+bool Archiver::InitIoUring()
+{
+	if (!m_IsIoUringChecked)
+	{
+		m_IsIoUringChecked = true;
+		if (!m_IoUring.Init(ARCHIVER_IO_QUEUE_DEPTH))
+			ThreadSafePrintf("io_uring is not available, package reads fall back to pread\n");
+	}
+
+	return m_IoUring.IsValid();
+}
+
+void Archiver::ReadPackageSpansIoUring(const MountIndex& index, PackageRead* pReads, const std::vector<size_t>& readIndices, const std::vector<PackageSpan>& spans, std::vector<size_t>& unreadSpans)
+{
+	size_t count = spans.size();
+	std::vector<void*> spanData(count, nullptr);
+	std::atomic<size_t> decompressionsLeft = 0;
+	size_t nextRead = 0;
+	size_t readsInFlight = 0;
+
+	std::unique_lock<std::mutex> lock(m_IoUringLock);
+	if (!InitIoUring())
+	{
+		for (size_t i = 0; i < count; i++)
+			unreadSpans.push_back(i);
+
+		return;
+	}
+
+	auto completeSpan = [&](uint64_t spanIndex, int32_t result)
+	{
+		readsInFlight--;
+
+		const PackageSpan& span = spans[spanIndex];
+		void* pSpanData = spanData[spanIndex];
+		void* pTarget = pSpanData ? pSpanData : pReads[readIndices[span.firstRead]].pBuf;
+
+		//Short reads and errors finish the span with pread
+		bool isRead = result >= 0 && size_t(result) == span.size;
+		if (!isRead)
+		{
+			size_t bytesRead = result > 0 ? size_t(result) : 0;
+			isRead = ReadFileAt(span.pPackage->fileDescriptor, reinterpret_cast<char*>(pTarget) + bytesRead, span.size - bytesRead, span.position + bytesRead);
+		}
+
+		if (!pSpanData)
+		{
+			pReads[readIndices[span.firstRead]].isRead = isRead;
+			return;
+		}
+
+		if (!isRead)
+		{
+			MemoryManager::GetInstance().Free(pSpanData);
+			return;
+		}
+
+		decompressionsLeft.fetch_add(1, std::memory_order_relaxed);
+		TaskManager::Get().Execute([this, &index, pReads, &readIndices, &span, &decompressionsLeft, pSpanData]()
+		{
+			FinishPackageSpan(index, pReads, readIndices, span, pSpanData);
+			MemoryManager::GetInstance().Free(pSpanData);
+			decompressionsLeft.fetch_sub(1, std::memory_order_release);
+		}, TaskManager::PRIORITY_NORMAL, "DecompressPackageData");
+	};
+
+	uint64_t spanIndex;
+	int32_t result;
+	bool isRingFailed = false;
+	while (nextRead < count || readsInFlight > 0)
+	{
+		//Top the queue up before waiting so the disk always has work
+		while (nextRead < count && readsInFlight < ARCHIVER_IO_QUEUE_DEPTH)
+		{
+			//A span of one uncompressed entry is read straight into its buffer
+			const PackageSpan& span = spans[nextRead];
+			PackageRead& firstRead = pReads[readIndices[span.firstRead]];
+			void* pTarget = firstRead.pBuf;
+			if (span.readCount > 1 || index.Find(firstRead.hash)->pRecord->compressedSize > 0)
+			{
+				spanData[nextRead] = MemoryManager::GetInstance().Allocate(span.size, 1, "Package Span");
+				pTarget = spanData[nextRead];
+			}
+
+			//A full submission queue is handled like a failed submission, the span that did not fit is read with pread
+			if (!m_IoUring.PrepareRead(span.pPackage->fileDescriptor, pTarget, uint32_t(span.size), span.position, nextRead))
+			{
+				ThreadSafePrintf("io_uring submission queue is full, falling back to pread\n");
+				isRingFailed = true;
+				break;
+			}
+
+			nextRead++;
+			readsInFlight++;
+		}
+
+		if (isRingFailed)
+			break;
+
+		if (!m_IoUring.Submit(readsInFlight > 0 ? 1 : 0))
+		{
+			ThreadSafePrintf("io_uring submission failed, falling back to pread\n");
+			isRingFailed = true;
+			break;
+		}
+
+		while (m_IoUring.PopCompletion(spanIndex, result))
+			completeSpan(spanIndex, result);
+	}
+
+	if (isRingFailed)
+	{
+		//The reads the kernel never took are the last ones prepared, they are read again with pread along with the span
+		//that could not be prepared and the ones after it
+		size_t submittedEnd = nextRead - m_IoUring.GetUnsubmittedCount();
+		readsInFlight -= m_IoUring.GetUnsubmittedCount();
+
+		//Reads that were handed to the kernel may still land in their buffers, so they have to complete before the ring is released
+		while (readsInFlight > 0)
+		{
+			while (m_IoUring.PopCompletion(spanIndex, result))
+				completeSpan(spanIndex, result);
+
+			if (readsInFlight > 0 && !m_IoUring.Wait(1))
+			{
+				//Nothing is known about these reads anymore, their buffers are given up instead of being reused
+				ThreadSafePrintf("io_uring lost %zu reads, their entries are not read\n", readsInFlight);
+				break;
+			}
+		}
+
+		for (size_t i = submittedEnd; i < count; i++)
+		{
+			if (spanData[i])
+				MemoryManager::GetInstance().Free(spanData[i]);
+
+			unreadSpans.push_back(i);
+		}
+
+		m_IoUring.Release();
+	}
+
+	//Decompression tasks can batch reads of their own, so the ring is unlocked before helping with the queue
+	lock.unlock();
+	TaskManager::Get().WaitForCounter(decompressionsLeft);
+}
+
+void Archiver::SetAccessRecording(bool isRecording)
+{
+	std::scoped_lock<SpinLock> lock(m_AccessLock);
+	if (isRecording && !m_IsRecordingAccess)
+	{
+		m_AccessOrder.clear();
+		m_RecordedAccesses.clear();
+	}
+
+	m_IsRecordingAccess = isRecording;
+}
+
+void Archiver::GetAccessOrder(std::vector<size_t>& order)
+{
+	std::scoped_lock<SpinLock> lock(m_AccessLock);
+	order = m_AccessOrder;
+}
+
+void Archiver::RecordAccess(size_t hash)
+{
+	if (!m_IsRecordingAccess.load(std::memory_order_relaxed))
+		return;
+
+	std::scoped_lock<SpinLock> lock(m_AccessLock);
+	if (m_RecordedAccesses.insert(hash).second)
+		m_AccessOrder.push_back(hash);
+}
+
+bool Archiver::HasPackageEntry(size_t hash)
+{
+	return GetMountIndex()->Find(hash) != nullptr;
+}
+
+size_t Archiver::GetPackageEntryType(size_t hash)
+{
+	std::shared_ptr<const MountIndex> pIndex = GetMountIndex();
+	const MountedEntry* pEntry = pIndex->Find(hash);
+	if (!pEntry)
+		return 0;
+
+	return pEntry->pRecord->typeHash;
+}
+
+std::string Archiver::GetPackageEntryName(size_t hash)
+{
+	std::shared_ptr<const MountIndex> pIndex = GetMountIndex();
+	const MountedEntry* pEntry = pIndex->Find(hash);
+	if (!pEntry)
+		return "";
+
+	return std::string(pEntry->pPackage->pStrings + pEntry->pRecord->nameOffset, pEntry->pRecord->nameLength);
+}
+
+bool Archiver::GetPackageEntryDependencies(size_t hash, std::vector<size_t>& dependencies)
+{
+	std::shared_ptr<const MountIndex> pIndex = GetMountIndex();
+	const MountedEntry* pEntry = pIndex->Find(hash);
+	if (!pEntry)
+		return false;
+
+	if (pEntry->pPackage->packageMode == MOUNT_DIRECTORY)
+	{
+		//Loose files only know their dependencies once they have been imported
+		return AccessLooseEntry(*pEntry->pPackage, pEntry->pRecord, false, [&](LooseEntry& entry)
+		{
+			dependencies.insert(dependencies.end(), entry.dependencies.begin(), entry.dependencies.end());
+			return true;
+		});
+	}
+
+	const uint64_t* pFirst = pEntry->pPackage->pDependencies + pEntry->pRecord->firstDependency;
+	dependencies.insert(dependencies.end(), pFirst, pFirst + pEntry->pRecord->dependencyCount);
+	return true;
+}
+
+bool Archiver::IsSharedWith(const MountIndex& index, const MountedEntry* pEntry, uint64_t sharedHash)
+{
+	//An entry that another mount overrides no longer shares anything with the rest of its package
+	const MountedEntry* pShared = index.Find(sharedHash);
+	return pShared && pShared->pPackage == pEntry->pPackage && pShared->pRecord->typeHash == pEntry->pRecord->typeHash;
+}
+
+size_t Archiver::GetPackageEntryCanonical(size_t hash)
+{
+	std::shared_ptr<const MountIndex> pIndex = GetMountIndex();
+	const MountedEntry* pEntry = pIndex->Find(hash);
+	if (!pEntry)
+		return hash;
+
+	auto shared = pEntry->pPackage->sharedEntries.find(pEntry->pRecord->offset);
+	if (shared == pEntry->pPackage->sharedEntries.end())
+		return hash;
+
+	//The hashes are in record order, so the first one of the same type is the smallest
+	for (uint64_t sharedHash : shared->second)
+	{
+		if (IsSharedWith(*pIndex, pEntry, sharedHash))
+			return sharedHash;
+	}
+
+	return hash;
+}
+
+bool Archiver::GetPackageEntryAliases(size_t hash, std::vector<size_t>& aliases)
+{
+	std::shared_ptr<const MountIndex> pIndex = GetMountIndex();
+	const MountedEntry* pEntry = pIndex->Find(hash);
+	if (!pEntry)
+		return false;
+
+	auto shared = pEntry->pPackage->sharedEntries.find(pEntry->pRecord->offset);
+	if (shared == pEntry->pPackage->sharedEntries.end())
+		return true;
+
+	//The same bytes under another type would be loaded into a different resource
+	for (uint64_t sharedHash : shared->second)
+	{
+		if (sharedHash != hash && IsSharedWith(*pIndex, pEntry, sharedHash))
+			aliases.push_back(sharedHash);
+	}
+
+	return true;
+}
+
+void Archiver::CreateUncompressedPackage()
+{
+	m_UncompressedPackageEntries.clear();
+	m_PackageEntryOrder.clear();
+}
+
+void Archiver::SetPackageCodec(size_t typeHash, PackageCodec codec)
+{
+	m_PackageCodecs[typeHash] = codec;
+}
+
+void Archiver::SetPackageEntryOrder(const std::vector<size_t>& hashes)
+{
+	m_PackageEntryOrder = hashes;
+}
+
+void Archiver::AddToUncompressedPackage(size_t hash, size_t typeHash, size_t sizeInBytes, void* pData)
+{
+	void* pDataCopy = MemoryManager::GetInstance().Allocate(sizeInBytes, 1, "Uncompressed Package Data");
+	memcpy(pDataCopy, pData, sizeInBytes);
+	m_UncompressedPackageEntries[hash] = UncompressedPackageEntry(typeHash, sizeInBytes, 0, pDataCopy);
+
+	auto codec = m_PackageCodecs.find(typeHash);
+	if (codec != m_PackageCodecs.end())
+		m_UncompressedPackageEntries[hash].packageEntryDesc.codec = codec->second;
+}
+
+void Archiver::SetUncompressedPackageEntryInfo(size_t hash, const std::string& name, const std::vector<size_t>& dependencies)
+{
+	auto entry = m_UncompressedPackageEntries.find(hash);
+	assert(entry != m_UncompressedPackageEntries.end());
+
+	entry->second.packageEntryDesc.name = name;
+	entry->second.packageEntryDesc.dependencies = dependencies;
+}
+
+void Archiver::SetUncompressedPackageEntrySource(size_t hash, const PackageSourceInfo& source)
+{
+	auto entry = m_UncompressedPackageEntries.find(hash);
+	assert(entry != m_UncompressedPackageEntries.end());
+
+	entry->second.packageEntryDesc.source = source;
+}
+
+void Archiver::RemoveFromUncompressedPackage(size_t hash)
+{
+	m_UncompressedPackageEntries.erase(hash);
+}
+
+void Archiver::SaveUncompressedPackage(const std::string& filename)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+#ifdef _DEBUG
+	size_t uncompressedDataSize = 0;
+#endif
+
+	TrainPackageDictionaries();
+
+	//The entries are kept in a std::map, so the records come out sorted by hash
+	std::vector<const UncompressedPackageEntry*> entries;
+	std::vector<const UncompressedPackageEntry*> entryDictionaries;
+	std::vector<PackageRecord> records;
+	std::vector<PackageSourceInfo> sources;
+	std::vector<uint64_t> dependencies;
+	std::string strings;
+	entries.reserve(m_UncompressedPackageEntries.size());
+	records.reserve(m_UncompressedPackageEntries.size());
+	sources.reserve(m_UncompressedPackageEntries.size());
+	for (auto& it : m_UncompressedPackageEntries)
+	{
+		const PackageEntryDescriptor& desc = it.second.packageEntryDesc;
+		PackageRecord record = {};
+		record.hash = it.first;
+		record.typeHash = desc.typeHash;
+		record.uncompressedSize = desc.uncompressedSize;
+		record.nameOffset = uint32_t(strings.size());
+		record.nameLength = uint32_t(desc.name.size());
+		record.firstDependency = uint32_t(dependencies.size());
+		record.dependencyCount = uint32_t(desc.dependencies.size());
+		record.codec = desc.codec;
+		strings += desc.name;
+		dependencies.insert(dependencies.end(), desc.dependencies.begin(), desc.dependencies.end());
+
+		const UncompressedPackageEntry* pDictionary = nullptr;
+		if (desc.codec == CODEC_DEFLATE_DICTIONARY)
+		{
+			auto dictionary = m_UncompressedPackageEntries.find(desc.typeHash | PACKAGE_DICTIONARY_HASH_BIT);
+			if (dictionary != m_UncompressedPackageEntries.end())
+			{
+				pDictionary = &dictionary->second;
+				record.dictionaryHash = dictionary->first;
+			}
+		}
+
+		if (desc.isStored)
+		{
+			record.compressedSize = desc.compressedSize;
+			record.dictionaryHash = desc.dictionaryHash;
+			record.contentHash = desc.contentHash;
+			pDictionary = nullptr;
+		}
+
+		entries.push_back(&it.second);
+		entryDictionaries.push_back(pDictionary);
+		records.push_back(record);
+		sources.push_back(desc.source);
+	}
+
+	TaskManager::Get().ParallelFor(0, entries.size(), 1, [&](size_t index)
+	{
+		if (!entries[index]->packageEntryDesc.isStored)
+			records[index].contentHash = XxHash::Hash64(entries[index]->pData, records[index].uncompressedSize);
+	});
+
+	//The data is written in the requested order, entries that are not listed follow in hash order
+	std::vector<size_t> writeOrder;
+	writeOrder.reserve(entries.size());
+	{
+		std::vector<bool> isOrdered(entries.size(), false);
+		for (size_t hash : m_PackageEntryOrder)
+		{
+			auto it = std::lower_bound(records.begin(), records.end(), hash, [](const PackageRecord& record, size_t hash)
+			{
+				return record.hash < hash;
+			});
+
+			size_t index = size_t(it - records.begin());
+			if (it != records.end() && it->hash == hash && !isOrdered[index])
+			{
+				isOrdered[index] = true;
+				writeOrder.push_back(index);
+			}
+		}
+
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			if (!isOrdered[i])
+				writeOrder.push_back(i);
+		}
+	}
+
+	//An entry with the same content as one written earlier is not compressed again, its record points at the data of the first.
+	//The bytes are compared as well since the hash alone could collide, and the codec has to match so both decode the same way.
+	//Entries copied from the previous package are compared in their stored form, so they only match each other
+	std::vector<size_t> canonicalEntries(entries.size());
+	std::unordered_multimap<uint64_t, size_t> entriesByContent;
+	size_t duplicateCount = 0;
+	size_t duplicateSize = 0;
+	for (size_t i : writeOrder)
+	{
+		canonicalEntries[i] = i;
+		const PackageRecord& record = records[i];
+		if (record.uncompressedSize == 0)
+			continue;
+
+		auto range = entriesByContent.equal_range(record.contentHash);
+		for (auto it = range.first; it != range.second; it++)
+		{
+			const PackageRecord& other = records[it->second];
+			bool isStored = entries[i]->packageEntryDesc.isStored;
+			size_t size = isStored && record.compressedSize > 0 ? record.compressedSize : record.uncompressedSize;
+			if (entries[it->second]->packageEntryDesc.isStored == isStored && other.uncompressedSize == record.uncompressedSize &&
+				other.compressedSize == record.compressedSize && other.codec == record.codec && other.dictionaryHash == record.dictionaryHash &&
+				memcmp(entries[it->second]->pData, entries[i]->pData, size) == 0)
+			{
+				canonicalEntries[i] = it->second;
+				break;
+			}
+		}
+
+		if (canonicalEntries[i] == i)
+		{
+			entriesByContent.emplace(record.contentHash, i);
+		}
+		else
+		{
+			duplicateCount++;
+			duplicateSize += record.uncompressedSize;
+		}
+	}
+
+	std::ofstream file;
+	file.open(filename + PACKAGE_FILE_EXTENSION, std::ios::out | std::ios::trunc | std::ios::binary);
+
+	//The table goes after the data since the offsets are only known once everything is compressed,
+	//the file header is written again at the end when the table position is known
+	PackageFileHeader fileHeader = {};
+	file.write(reinterpret_cast<char*>(&fileHeader), sizeof(PackageFileHeader));
+
+	//Entries are compressed on the workers and written in order as soon as they are done,
+	//at most ARCHIVER_SAVE_IN_FLIGHT entries are compressed ahead of the writer to bound the memory use
+	std::vector<void*> compressedData(entries.size(), nullptr);
+	std::vector<std::vector<uint32_t>> entryBlocks(entries.size());
+	std::vector<uint32_t> blocks;
+	std::unique_ptr<std::atomic<size_t>[]> compressionsLeft(new std::atomic<size_t>[entries.size()]);
+	size_t nextCompression = 0;
+	size_t compressedDataSize = 0;
+	for (size_t position = 0; position < entries.size(); position++)
+	{
+		for (; nextCompression < entries.size() && nextCompression < position + ARCHIVER_SAVE_IN_FLIGHT; nextCompression++)
+		{
+			size_t index = writeOrder[nextCompression];
+			bool isWritten = canonicalEntries[index] != index || entries[index]->packageEntryDesc.isStored;
+			compressionsLeft[index].store(isWritten ? 0 : 1, std::memory_order_relaxed);
+			if (isWritten)
+				continue;
+
+			TaskManager::Get().Execute([&, index]()
+			{
+				const UncompressedPackageEntry& entry = *entries[index];
+				size_t size = entry.packageEntryDesc.uncompressedSize;
+				void* pCompressed = MemoryManager::GetInstance().Allocate(size, 1, "Archiver Compressed Buffer");
+
+				//Entries that do not get smaller are stored as is
+				PackageRecord& record = records[index];
+				const UncompressedPackageEntry* pDictionary = entryDictionaries[index];
+				const void* pDictionaryData = pDictionary ? pDictionary->pData : nullptr;
+				size_t dictionarySize = pDictionary ? pDictionary->packageEntryDesc.uncompressedSize : 0;
+				if (size <= PACKAGE_BLOCK_SIZE)
+					record.compressedSize = CompressData(PackageCodec(record.codec), entry.pData, size, pCompressed, size, pDictionaryData, dictionarySize);
+				else
+					record.compressedSize = CompressBlocks(PackageCodec(record.codec), entry.pData, size, pCompressed, pDictionaryData, dictionarySize, entryBlocks[index]);
+
+				if (record.compressedSize == 0)
+				{
+					record.codec = CODEC_NONE;
+					record.dictionaryHash = 0;
+					entryBlocks[index].clear();
+				}
+
+				compressedData[index] = pCompressed;
+				compressionsLeft[index].store(0, std::memory_order_release);
+			}, TaskManager::PRIORITY_NORMAL, "DeflatePackageData");
+		}
+
+		size_t i = writeOrder[position];
+		TaskManager::Get().WaitForCounter(compressionsLeft[i]);
+
+		PackageRecord& record = records[i];
+
+#ifdef _DEBUG
+		uncompressedDataSize += record.uncompressedSize;
+#endif
+
+		//The canonical entry comes first in the write order, so it has been written already
+		if (canonicalEntries[i] != i)
+		{
+			const PackageRecord& canonical = records[canonicalEntries[i]];
+			record.offset = canonical.offset;
+			record.compressedSize = canonical.compressedSize;
+			record.codec = canonical.codec;
+			record.dictionaryHash = canonical.dictionaryHash;
+			record.firstBlock = canonical.firstBlock;
+			continue;
+		}
+
+		record.offset = compressedDataSize;
+		record.firstBlock = uint32_t(blocks.size());
+		if (entries[i]->packageEntryDesc.isStored)
+		{
+			const PackageEntryDescriptor& desc = entries[i]->packageEntryDesc;
+			blocks.insert(blocks.end(), desc.blocks.begin(), desc.blocks.end());
+			size_t storedSize = record.compressedSize > 0 ? record.compressedSize : record.uncompressedSize;
+			file.write(reinterpret_cast<char*>(entries[i]->pData), storedSize);
+			compressedDataSize += storedSize;
+			continue;
+		}
+
+		blocks.insert(blocks.end(), entryBlocks[i].begin(), entryBlocks[i].end());
+		if (record.compressedSize > 0)
+		{
+			file.write(reinterpret_cast<char*>(compressedData[i]), record.compressedSize);
+			compressedDataSize += record.compressedSize;
+		}
+		else
+		{
+			file.write(reinterpret_cast<char*>(entries[i]->pData), record.uncompressedSize);
+			compressedDataSize += record.uncompressedSize;
+		}
+
+		MemoryManager::GetInstance().Free(compressedData[i]);
+		compressedData[i] = nullptr;
+	}
+
+	PackageTableInfo info = {};
+	info.entryCount = records.size();
+	info.dataSize = compressedDataSize;
+	info.dependencyCount = dependencies.size();
+	info.stringsSize = strings.size();
+	info.blockCount = blocks.size();
+	info.blockSize = PACKAGE_BLOCK_SIZE;
+
+	size_t headerSize = sizeof(PackageTableInfo) + records.size() * (sizeof(PackageRecord) + sizeof(PackageSourceInfo)) + dependencies.size() * sizeof(uint64_t) + blocks.size() * sizeof(uint32_t) + strings.size();
+	char* pHeader = (char*)MemoryManager::GetInstance().Allocate(headerSize, alignof(PackageRecord), "Archiver Package Uncompressed Header");
+	char* pHeaderPosition = pHeader;
+	memcpy(pHeaderPosition, &info, sizeof(PackageTableInfo));
+	pHeaderPosition += sizeof(PackageTableInfo);
+	memcpy(pHeaderPosition, records.data(), records.size() * sizeof(PackageRecord));
+	pHeaderPosition += records.size() * sizeof(PackageRecord);
+	memcpy(pHeaderPosition, sources.data(), sources.size() * sizeof(PackageSourceInfo));
+	pHeaderPosition += sources.size() * sizeof(PackageSourceInfo);
+	memcpy(pHeaderPosition, dependencies.data(), dependencies.size() * sizeof(uint64_t));
+	pHeaderPosition += dependencies.size() * sizeof(uint64_t);
+	memcpy(pHeaderPosition, blocks.data(), blocks.size() * sizeof(uint32_t));
+	pHeaderPosition += blocks.size() * sizeof(uint32_t);
+	memcpy(pHeaderPosition, strings.data(), strings.size());
+
+	size_t compressedHeaderMaxSize = compressBound(uLong(headerSize));
+	void* pCompressedHeader = MemoryManager::GetInstance().Allocate(compressedHeaderMaxSize, 1, "Archiver Package Compressed Header");
+	size_t compressedHeaderSize = CompressHeader(pHeader, headerSize, pCompressedHeader, compressedHeaderMaxSize);
+
+	fileHeader.magic = PACKAGE_MAGIC;
+	fileHeader.version = PACKAGE_VERSION;
+	fileHeader.tableOffset = sizeof(PackageFileHeader) + compressedDataSize;
+	fileHeader.tableCompressedSize = compressedHeaderSize;
+	fileHeader.tableUncompressedSize = headerSize;
+
+	file.write(reinterpret_cast<char*>(pCompressedHeader), compressedHeaderSize);
+	file.seekp(0, std::ios_base::beg);
+	file.write(reinterpret_cast<char*>(&fileHeader), sizeof(PackageFileHeader));
+	file.close();
+
+	MemoryManager::GetInstance().Free(pHeader);
+	MemoryManager::GetInstance().Free(pCompressedHeader);
+
+	float buildTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	ThreadSafePrintf("Package [%s] with %zu entries saved in %.2f ms, %zu duplicates (%zu bytes) stored once\n", (filename + PACKAGE_FILE_EXTENSION).c_str(), records.size(), buildTime, duplicateCount, duplicateSize);
+
+#ifdef _DEBUG
+	std::cout << std::endl << "Compressed Package: " << std::endl;
+	std::cout << "Uncompressed Size: " << (uncompressedDataSize + headerSize) << " bytes" << std::endl;
+	std::cout << "Compressed Size: " << (compressedDataSize + compressedHeaderSize) << " bytes" << std::endl;
+	std::cout << "Compressed Relative Size: " << (100.0f * (float)(compressedDataSize + compressedHeaderSize) / (uncompressedDataSize + headerSize)) << "%" << std::endl << std::endl;
+#endif
+}
+
+size_t Archiver::CompressBlocks(PackageCodec codec, const void* pData, size_t size, void* pBuf, const void* pDictionary, size_t dictionarySize, std::vector<uint32_t>& blockSizes)
+{
+	size_t blockCount = (size + PACKAGE_BLOCK_SIZE - 1) / PACKAGE_BLOCK_SIZE;
+	blockSizes.assign(blockCount, 0);
+
+	//Every block is compressed into its own slot of the buffer, a block only counts as compressed if it got smaller
+	TaskManager::Get().ParallelFor(0, blockCount, 1, [&](size_t block)
+	{
+		size_t offset = block * PACKAGE_BLOCK_SIZE;
+		size_t blockSize = std::min(size_t(PACKAGE_BLOCK_SIZE), size - offset);
+		const char* pSource = reinterpret_cast<const char*>(pData) + offset;
+		char* pSlot = reinterpret_cast<char*>(pBuf) + offset;
+
+		size_t compressedSize = CompressData(codec, pSource, blockSize, pSlot, blockSize - 1, pDictionary, dictionarySize);
+		if (compressedSize == 0)
+		{
+			memcpy(pSlot, pSource, blockSize);
+			compressedSize = blockSize;
+		}
+
+		blockSizes[block] = uint32_t(compressedSize);
+	});
+
+	//Then the slots are packed, every block moves towards the start so nothing is overwritten before it is moved
+	size_t compressedSize = 0;
+	for (size_t block = 0; block < blockCount; block++)
+	{
+		memmove(reinterpret_cast<char*>(pBuf) + compressedSize, reinterpret_cast<char*>(pBuf) + block * PACKAGE_BLOCK_SIZE, blockSizes[block]);
+		compressedSize += blockSizes[block];
+	}
+
+	return compressedSize < size ? compressedSize : 0;
+}
+
+void Archiver::TrainPackageDictionaries()
+{
+	std::unordered_map<size_t, std::vector<std::pair<const void*, size_t>>> samples;
+	for (auto& it : m_UncompressedPackageEntries)
+	{
+		//Entries copied from the previous package are already compressed
+		const PackageEntryDescriptor& desc = it.second.packageEntryDesc;
+		if (desc.codec == CODEC_DEFLATE_DICTIONARY && !desc.isStored)
+			samples[desc.typeHash].push_back({ it.second.pData, desc.uncompressedSize });
+	}
+
+	for (auto& it : samples)
+	{
+		size_t dictionaryHash = it.first | PACKAGE_DICTIONARY_HASH_BIT;
+		auto previous = m_UncompressedPackageEntries.find(dictionaryHash);
+		if (previous != m_UncompressedPackageEntries.end())
+		{
+			//A dictionary copied from the previous package is kept, the entries copied along with it need it
+			if (previous->second.packageEntryDesc.isStored)
+				continue;
+
+			MemoryManager::GetInstance().Free(previous->second.pData);
+			m_UncompressedPackageEntries.erase(previous);
+		}
+
+		std::string dictionary = TrainDictionary(it.second, PACKAGE_DICTIONARY_SIZE);
+		if (dictionary.empty())
+			continue;
+
+		//Typed as a dictionary so a resource loader never claims it, and stored as is so reading it needs no dictionary
+		AddToUncompressedPackage(dictionaryHash, PACKAGE_DICTIONARY_HASH_BIT, dictionary.size(), dictionary.data());
+		m_UncompressedPackageEntries[dictionaryHash].packageEntryDesc.codec = CODEC_NONE;
+	}
+}
+
+std::string Archiver::TrainDictionary(const std::vector<std::pair<const void*, size_t>>& samples, size_t dictionarySize)
+{
+	constexpr size_t runLength = sizeof(uint64_t);
+	constexpr size_t segmentLength = 64;
+
+	struct RunCount
+	{
+		uint32_t sampleCount;
+		uint32_t lastSample;
+	};
+
+	struct Segment
+	{
+		const uint8_t* pData;
+		uint64_t score;
+	};
+
+	//Count how many samples every 8 byte run shows up in, runs that only one sample has are worthless
+	std::unordered_map<uint64_t, RunCount> runCounts;
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		const uint8_t* pData = reinterpret_cast<const uint8_t*>(samples[i].first);
+		size_t size = std::min(samples[i].second, size_t(PACKAGE_DICTIONARY_SAMPLE_SIZE));
+		for (size_t position = 0; position + runLength <= size; position++)
+		{
+			uint64_t run;
+			memcpy(&run, pData + position, runLength);
+			RunCount& runCount = runCounts[run];
+			if (runCount.lastSample != i + 1)
+			{
+				runCount.sampleCount++;
+				runCount.lastSample = uint32_t(i + 1);
+			}
+		}
+	}
+
+	auto scoreSegment = [&](const uint8_t* pData)
+	{
+		uint64_t score = 0;
+		for (size_t position = 0; position + runLength <= segmentLength; position++)
+		{
+			uint64_t run;
+			memcpy(&run, pData + position, runLength);
+			score += runCounts[run].sampleCount - 1;
+		}
+		return score;
+	};
+
+	std::vector<Segment> segments;
+	for (const std::pair<const void*, size_t>& sample : samples)
+	{
+		const uint8_t* pData = reinterpret_cast<const uint8_t*>(sample.first);
+		size_t size = std::min(sample.second, size_t(PACKAGE_DICTIONARY_SAMPLE_SIZE));
+		for (size_t position = 0; position + segmentLength <= size; position += segmentLength / 2)
+		{
+			uint64_t score = scoreSegment(pData + position);
+			if (score > 0)
+				segments.push_back({ pData + position, score });
+		}
+	}
+
+	std::sort(segments.begin(), segments.end(), [](const Segment& a, const Segment& b)
+	{
+		return a.score > b.score;
+	});
+
+	//Runs are only worth having once, so picked runs stop counting towards the segments after them
+	std::vector<const uint8_t*> picked;
+	for (size_t i = 0; i < segments.size() && picked.size() * segmentLength + segmentLength <= dictionarySize; i++)
+	{
+		if (scoreSegment(segments[i].pData) == 0)
+			continue;
+
+		picked.push_back(segments[i].pData);
+		for (size_t position = 0; position + runLength <= segmentLength; position++)
+		{
+			uint64_t run;
+			memcpy(&run, segments[i].pData + position, runLength);
+			runCounts[run].sampleCount = 1;
+		}
+	}
+
+	//Deflate codes closer matches with fewer bits, so the best segments go at the end
+	std::string dictionary;
+	dictionary.reserve(picked.size() * segmentLength);
+	for (auto it = picked.rbegin(); it != picked.rend(); ++it)
+		dictionary.append(reinterpret_cast<const char*>(*it), segmentLength);
+
+	return dictionary;
+}
+
+size_t Archiver::DeflateEntry(const void* pData, size_t size, void* pBuf, size_t bufSize, int level, const void* pDictionary, size_t dictionarySize)
+{
+	int err;
+	z_stream compressionStream;
+	compressionStream.zalloc = zalloc;
+	compressionStream.zfree = zfree;
+	compressionStream.opaque = nullptr;
+
+	err = deflateInit(&compressionStream, level);
+	ARCHIVER_CHECK_ERR(err, "deflateInit");
+
+	if (pDictionary != nullptr && dictionarySize > 0)
+	{
+		err = deflateSetDictionary(&compressionStream, reinterpret_cast<const Bytef*>(pDictionary), (uInt)dictionarySize);
+		ARCHIVER_CHECK_ERR(err, "deflateSetDictionary");
+	}
+
+	compressionStream.next_in = reinterpret_cast<Byte*>(const_cast<void*>(pData));
+	compressionStream.next_out = reinterpret_cast<Byte*>(pBuf);
+	compressionStream.avail_in = (uInt)size;
+	compressionStream.avail_out = (uInt)bufSize;
+
+	//Z_OK and Z_BUF_ERROR mean the output did not fit
+	err = deflate(&compressionStream, Z_FINISH);
+	size_t compressedSize = err == Z_STREAM_END ? size_t(compressionStream.total_out) : 0;
+
+	err = deflateEnd(&compressionStream);
+	assert(err == Z_OK || err == Z_DATA_ERROR);
+
+	return compressedSize;
+}
+
+void Archiver::CloseUncompressedPackage()
+{
+	for (auto& it : m_UncompressedPackageEntries)
+	{
+		if (it.second.pData != nullptr)
+		{
+			MemoryManager::GetInstance().Free(it.second.pData);
+			it.second.pData = nullptr;
+		}
+	}
+
+	m_UncompressedPackageEntries.clear();
+	m_PackageEntryOrder.clear();
+}
+
+bool Archiver::OpenPreviousPackage(const std::string& filename)
+{
+	ClosePreviousPackage();
+
+	m_PreviousPackage.filename = filename + PACKAGE_FILE_EXTENSION;
+	m_PreviousPackage.pFileStream = new std::ifstream();
+	m_PreviousPackage.pFileStream->open(m_PreviousPackage.filename, std::ios::in | std::ios::binary);
+	if (!m_PreviousPackage.pFileStream->is_open())
+	{
+		ClosePreviousPackage();
+		return false;
+	}
+
+	//Chunked entries can only be copied into a package with the same block size
+	ReadPackageHeader(m_PreviousPackage, *m_PreviousPackage.pFileStream);
+	if (m_PreviousPackage.pTable == nullptr || m_PreviousPackage.blockSize != PACKAGE_BLOCK_SIZE)
+	{
+		ClosePreviousPackage();
+		return false;
+	}
+
+	m_PreviousPackage.isPackageOpen = true;
+	m_PreviousPackage.packageMode = LOAD_AND_PREPARE;
+	m_PreviousPackage.fileDataStart = sizeof(PackageFileHeader);
+	return true;
+}
+
+void Archiver::ClosePreviousPackage()
+{
+	m_PreviousPackage.Reset();
+}
+
+bool Archiver::GetPreviousPackageSource(size_t hash, PackageSourceInfo& source)
+{
+	const PackageRecord* pRecord = FindPackageRecord(m_PreviousPackage, hash);
+	if (!pRecord)
+		return false;
+
+	source = m_PreviousPackage.pSources[pRecord - m_PreviousPackage.pRecords];
+	return true;
+}
+
+bool Archiver::AddFromPreviousPackage(size_t hash, const PackageSourceInfo& source)
+{
+	const PackageRecord* pRecord = FindPackageRecord(m_PreviousPackage, hash);
+	if (!pRecord)
+		return false;
+
+	//Entries stored with another codec than the one now set for the type are compressed again
+	auto codec = m_PackageCodecs.find(pRecord->typeHash);
+	PackageCodec typeCodec = codec != m_PackageCodecs.end() ? codec->second : CODEC_DEFLATE;
+	if (pRecord->codec != CODEC_NONE && pRecord->codec != typeCodec)
+		return false;
+
+	//The dictionary comes along as it is, training a new one would break the entries compressed with it
+	if (pRecord->dictionaryHash != 0)
+	{
+		auto dictionary = m_UncompressedPackageEntries.find(pRecord->dictionaryHash);
+		if (dictionary == m_UncompressedPackageEntries.end() || !dictionary->second.packageEntryDesc.isStored)
+		{
+			const PackageRecord* pDictionaryRecord = FindPackageRecord(m_PreviousPackage, pRecord->dictionaryHash);
+			UncompressedPackageEntry dictionaryEntry;
+			if (!pDictionaryRecord || !ReadPreviousEntry(pDictionaryRecord, dictionaryEntry))
+				return false;
+
+			if (dictionary != m_UncompressedPackageEntries.end())
+				MemoryManager::GetInstance().Free(dictionary->second.pData);
+
+			m_UncompressedPackageEntries[pRecord->dictionaryHash] = dictionaryEntry;
+		}
+	}
+
+	UncompressedPackageEntry entry;
+	if (!ReadPreviousEntry(pRecord, entry))
+		return false;
+
+	entry.packageEntryDesc.source = source;
+	m_UncompressedPackageEntries[hash] = entry;
+	return true;
+}
+
+bool Archiver::ReadPreviousEntry(const PackageRecord* pRecord, UncompressedPackageEntry& entry)
+{
+	size_t blockCount = 0;
+	if (pRecord->compressedSize > 0 && pRecord->uncompressedSize > m_PreviousPackage.blockSize)
+	{
+		blockCount = (pRecord->uncompressedSize + m_PreviousPackage.blockSize - 1) / m_PreviousPackage.blockSize;
+		if (pRecord->firstBlock + blockCount > m_PreviousPackage.numBlocks)
+			return false;
+	}
+
+	size_t storedSize = pRecord->compressedSize > 0 ? pRecord->compressedSize : pRecord->uncompressedSize;
+	void* pData = MemoryManager::GetInstance().Allocate(storedSize, 1, "Uncompressed Package Data");
+	std::ifstream& fileStream = *m_PreviousPackage.pFileStream;
+	fileStream.seekg(m_PreviousPackage.fileDataStart + pRecord->offset, std::ios_base::beg);
+	fileStream.read(reinterpret_cast<char*>(pData), storedSize);
+	if (!fileStream.good())
+	{
+		fileStream.clear();
+		MemoryManager::GetInstance().Free(pData);
+		return false;
+	}
+
+	entry = UncompressedPackageEntry(pRecord->typeHash, pRecord->uncompressedSize, pRecord->compressedSize, pData);
+	PackageEntryDescriptor& desc = entry.packageEntryDesc;
+	desc.codec = PackageCodec(pRecord->codec);
+	desc.name = std::string(m_PreviousPackage.pStrings + pRecord->nameOffset, pRecord->nameLength);
+	desc.dependencies.assign(m_PreviousPackage.pDependencies + pRecord->firstDependency, m_PreviousPackage.pDependencies + pRecord->firstDependency + pRecord->dependencyCount);
+	desc.source = m_PreviousPackage.pSources[pRecord - m_PreviousPackage.pRecords];
+	desc.isStored = true;
+	desc.contentHash = pRecord->contentHash;
+	desc.dictionaryHash = pRecord->dictionaryHash;
+	desc.blocks.assign(m_PreviousPackage.pBlocks + pRecord->firstBlock, m_PreviousPackage.pBlocks + pRecord->firstBlock + blockCount);
+	return true;
+}
+
+void* Archiver::DecompressHeader(std::ifstream& fileStream, size_t& headerSize, const std::string& filename)
+{
+	PackageFileHeader fileHeader = {};
+	fileStream.read(reinterpret_cast<char*>(&fileHeader), sizeof(PackageFileHeader));
+	if (!fileStream.good() || fileHeader.magic != PACKAGE_MAGIC || fileHeader.version != PACKAGE_VERSION)
+	{
+		ThreadSafePrintf("[%s] is not a version %u package, it has to be created again!\n", filename.c_str(), PACKAGE_VERSION);
+		return nullptr;
+	}
+
+	//The table is stored after the data, callers expect the stream to be left at the start of the data
+	fileStream.seekg(0, std::ios_base::end);
+	size_t fileSize = size_t(fileStream.tellg());
+	if (fileHeader.tableOffset < sizeof(PackageFileHeader) || fileHeader.tableOffset > fileSize || fileHeader.tableCompressedSize > fileSize - fileHeader.tableOffset)
+	{
+		ThreadSafePrintf("Package table of [%s] is corrupt!\n", filename.c_str());
+		return nullptr;
+	}
+
+	fileStream.seekg(fileHeader.tableOffset, std::ios_base::beg);
+
+	size_t headerCompressedSize = fileHeader.tableCompressedSize;
+	size_t headerUncompressedSize = fileHeader.tableUncompressedSize;
+	headerSize = headerUncompressedSize;
+
+	//The records are read in place, so the table has to be aligned for them
+	void* pCompressedHeader = MemoryManager::GetInstance().Allocate(headerCompressedSize, 1, "Archiver Package Compressed Header");
+	void* pDecompressedHeader = MemoryManager::GetInstance().Allocate(headerUncompressedSize, alignof(PackageRecord), "Archiver Package Uncompressed Header");
+	fileStream.read(reinterpret_cast<char*>(pCompressedHeader), headerCompressedSize);
+
+	int err;
+	z_stream decompressionStream;
+	decompressionStream.zalloc = zalloc;
+	decompressionStream.zfree = zfree;
+	decompressionStream.opaque = nullptr;
+
+	err = inflateInit(&decompressionStream);
+	ARCHIVER_CHECK_ERR(err, "inflateInit");
+
+	decompressionStream.next_in = reinterpret_cast<Byte*>(pCompressedHeader);
+	decompressionStream.next_out = reinterpret_cast<Byte*>(pDecompressedHeader);
+	decompressionStream.avail_in = (uInt)headerCompressedSize;
+	decompressionStream.avail_out = (uInt)headerUncompressedSize;
+
+	//The table is used in place, so one that does not inflate to exactly its recorded size is rejected
+	bool isRead = fileStream.good();
+	err = isRead ? inflate(&decompressionStream, Z_FINISH) : Z_DATA_ERROR;
+	bool isInflated = err == Z_STREAM_END && decompressionStream.total_out == headerUncompressedSize;
+
+	err = inflateEnd(&decompressionStream);
+	ARCHIVER_CHECK_ERR(err, "inflateEnd");
+
+	MemoryManager::GetInstance().Free(pCompressedHeader);
+	fileStream.clear();
+	fileStream.seekg(sizeof(PackageFileHeader), std::ios_base::beg);
+	if (!isInflated)
+	{
+		ThreadSafePrintf("Package table of [%s] is corrupt!\n", filename.c_str());
+		MemoryManager::GetInstance().Free(pDecompressedHeader);
+		return nullptr;
+	}
 
-	MemoryManager::GetInstance().Free(pCompressedHeader);
 	return pDecompressedHeader;
 }
 
@@ -5,23 +5,181 @@
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <functional>
+#include <atomic>
+#include <memory>
 #include "MemoryManager.h"
 #include "SpinLock.h"
+#include "AsyncTask.h"
+#include "IoUring.h"
+#include "Lz4.h"
+#include "XxHash.h"
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <queue>
+#include <coroutine>
+
+//Reads kept in flight by ReadPackageDataBatch
+#define ARCHIVER_IO_QUEUE_DEPTH 64
+//Entries SaveUncompressedPackage compresses ahead of the one being written
+#define ARCHIVER_SAVE_IN_FLIGHT 64
+//Deflate cannot look further back than 32 KB, so a larger preset dictionary is never used
+#define PACKAGE_DICTIONARY_SIZE 32768
+//Bytes of every sample that dictionary training looks at
+#define PACKAGE_DICTIONARY_SAMPLE_SIZE 65536
+//Dictionary entries are stored under their type hash with this bit set, resource GUIDs never have it
+#define PACKAGE_DICTIONARY_HASH_BIT (1ull << 63)
+//Entries larger than this are compressed in independent blocks that can be decompressed in parallel
+#define PACKAGE_BLOCK_SIZE (256 * 1024)
+//Compressed bytes ReadPackageDataPrefix reads first, before it falls back to the whole first block
+#define PACKAGE_PREFIX_READ_SIZE 4096
+//Priority OpenCompressedPackage mounts at, DLC and patches are mounted above it to override its entries
+#define PACKAGE_BASE_PRIORITY 0
+//Batched reads of entries that are at most this far apart in the file are merged into one read
+#define PACKAGE_COALESCE_GAP (64 * 1024)
+//Merged reads stop growing at this size, so a batch still keeps several reads in flight
+#define PACKAGE_COALESCE_SIZE (4 * 1024 * 1024)
+//Stored bytes ReadPackageDataStreamed reads and decoded bytes it hands to the sink at a time
+#define PACKAGE_STREAM_WINDOW_SIZE (256 * 1024)
+//Prepared packages decode compressed entries larger than this in windows instead of reading them whole
+#define PACKAGE_STREAM_THRESHOLD (8 * 1024 * 1024)
 
 class Archiver
 {	
 	static constexpr char PACKAGE_FILE_EXTENSION[] = ".chat";
 	static constexpr char COMPRESSION_LEVEL = Z_DEFAULT_COMPRESSION;
+	static constexpr char DICTIONARY_COMPRESSION_LEVEL = Z_BEST_COMPRESSION;
+	static constexpr uint32_t PACKAGE_MAGIC = 0x54414843; //"CHAT"
+	static constexpr uint32_t PACKAGE_VERSION = 7;
 
 public:
 	enum PackageMode : unsigned char
 	{
 		UNDEFINED,
 		LOAD_AND_STORE,
-		LOAD_AND_PREPARE
+		LOAD_AND_PREPARE,
+		//Maps the file, falls back to LOAD_AND_PREPARE where mapping is not supported
+		LOAD_MAPPED,
+		//Loose files of a directory that are imported on first use, set by MountDirectory
+		MOUNT_DIRECTORY
+	};
+
+	enum PackageCodec : uint32_t
+	{
+		CODEC_NONE,
+		CODEC_DEFLATE,
+		//Fast to decode, meant for large binary entries like meshes and textures
+		CODEC_LZ4,
+		//Deflate at the highest level with a preset dictionary trained on all entries of the same type
+		CODEC_DEFLATE_DICTIONARY
+	};
+
+	//What an entry was built from. An incremental build copies the stored entry from the previous package
+	//as long as the source and the importer that turned it into the entry have not changed
+	struct PackageSourceInfo
+	{
+		uint64_t modifiedTime;
+		uint64_t sourceHash;
+		uint32_t importerVersion;
+		uint32_t reserved;
+	};
+
+	//A file of a mounted directory, the name is relative to the directory
+	struct LooseFile
+	{
+		size_t hash;
+		size_t typeHash;
+		std::string name;
+	};
+
+	//Turns a loose file into the data a package entry would hold. Returns the data allocated with the MemoryManager,
+	//or nullptr if the file cannot be imported
+	using DirectoryImporter = std::function<void*(size_t hash, const std::string& path, size_t& size, std::vector<size_t>& dependencies)>;
+
+	//Receives an entry in order, a piece at a time. The data is only valid during the call, returning false stops the read
+	using PackageSink = std::function<bool(const void* pData, size_t size)>;
+
+	struct PackageRead
+	{
+		size_t hash;
+		void* pBuf;
+		size_t bufSize;
+		size_t typeHash;
+		bool isRead;
+	};
+
+	//Hands the batch to the archiver's I/O thread and resumes the coroutine on a worker once every read is finished
+	struct PackageBatchAwaiter
+	{
+		inline bool await_ready() const noexcept
+		{
+			return count == 0;
+		}
+
+		inline void await_suspend(std::coroutine_handle<> handle) const
+		{
+			pArchiver->QueueBatch(pReads, count, handle);
+		}
+
+		inline void await_resume() const noexcept
+		{
+		}
+
+		Archiver* pArchiver;
+		PackageRead* pReads;
+		size_t count;
 	};
 
 private:
+	//Written uncompressed at the start of the file, followed by the entry data and then the compressed table
+	struct PackageFileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t tableOffset;
+		uint64_t tableCompressedSize;
+		uint64_t tableUncompressedSize;
+	};
+
+	//The inflated table is used as is: the info, the records sorted by hash, the source of every record,
+	//the dependencies, the compressed size of every block and then the names
+	struct PackageTableInfo
+	{
+		uint64_t entryCount;
+		uint64_t dataSize;
+		uint64_t dependencyCount;
+		uint64_t stringsSize;
+		uint64_t blockCount;
+		uint64_t blockSize;
+	};
+
+	struct PackageRecord
+	{
+		uint64_t hash;
+		uint64_t typeHash;
+		uint64_t offset;
+		uint64_t uncompressedSize;
+		uint64_t compressedSize;
+		uint32_t nameOffset;
+		uint32_t nameLength;
+		uint32_t firstDependency;
+		uint32_t dependencyCount;
+		uint64_t dictionaryHash;
+		uint32_t codec;
+		//Compressed entries larger than the block size are split into blocks, a block that did not shrink is stored
+		//as is and its size in the block index is the uncompressed size
+		uint32_t firstBlock;
+		//XXH64 of the uncompressed data, entries with the same content share the stored data
+		uint64_t contentHash;
+	};
+	static_assert(sizeof(PackageRecord) == 80, "Package records are stored on disk and must not change size");
+
 	struct PackageEntryDescriptor
 	{
 		PackageEntryDescriptor()
@@ -30,6 +188,11 @@ private:
 			this->offset = 0;
 			this->uncompressedSize = 0;
 			this->compressedSize = 0;
+			this->codec = CODEC_DEFLATE;
+			this->source = {};
+			this->isStored = false;
+			this->contentHash = 0;
+			this->dictionaryHash = 0;
 		}
 
 		PackageEntryDescriptor(size_t typeHash, size_t offset, size_t uncompressedSize, size_t compressedSize)
@@ -38,12 +201,27 @@ private:
 			this->offset = offset;
 			this->uncompressedSize = uncompressedSize;
 			this->compressedSize = compressedSize;
+			this->codec = CODEC_DEFLATE;
+			this->source = {};
+			this->isStored = false;
+			this->contentHash = 0;
+			this->dictionaryHash = 0;
 		}
 
 		size_t typeHash;
 		size_t offset;
 		size_t uncompressedSize;
 		size_t compressedSize;
+		PackageCodec codec;
+		std::string name;
+		std::vector<size_t> dependencies;
+		PackageSourceInfo source;
+
+		//Copied from the previous package, the data is already in its stored form and is written as is
+		bool isStored;
+		uint64_t contentHash;
+		uint64_t dictionaryHash;
+		std::vector<uint32_t> blocks;
 	};
 
 	struct UncompressedPackageEntry
@@ -78,15 +256,36 @@ private:
 		void* pData;
 	};
 
+	struct LooseEntry
+	{
+		void* pData = nullptr;
+		size_t size = 0;
+		std::vector<size_t> dependencies;
+		bool isImported = false;
+	};
+
 	struct Package
 	{
 		Package()
 		{
+			this->priority = PACKAGE_BASE_PRIORITY;
 			this->filename = "None";
 			this->pFileStream = nullptr;
 			this->isPackageOpen = false;
 			this->packageMode = UNDEFINED;
 			this->pData = nullptr;
+			this->pTable = nullptr;
+			this->pRecords = nullptr;
+			this->numRecords = 0;
+			this->pSources = nullptr;
+			this->pDependencies = nullptr;
+			this->pStrings = nullptr;
+			this->pBlocks = nullptr;
+			this->numBlocks = 0;
+			this->blockSize = 0;
+			this->pMapping = nullptr;
+			this->mappingSize = 0;
+			this->fileDescriptor = -1;
 		}
 
 		~Package()
@@ -106,15 +305,81 @@ private:
 			}
 			this->pFileStream = nullptr;
 			this->isPackageOpen = false;
+
+			//Stored packages own their data section, mapped ones point into the mapping
+			if (this->packageMode == LOAD_AND_STORE && this->pData != nullptr)
+				MemoryManager::GetInstance().Free(this->pData);
+
+			this->pData = nullptr;
 			this->packageMode = UNDEFINED;
-			this->table.clear();
+
+			if (this->pTable != nullptr)
+				MemoryManager::GetInstance().Free(this->pTable);
+
+			this->pTable = nullptr;
+			this->pRecords = nullptr;
+			this->numRecords = 0;
+			this->pSources = nullptr;
+			this->pDependencies = nullptr;
+			this->pStrings = nullptr;
+			this->pBlocks = nullptr;
+			this->numBlocks = 0;
+			this->blockSize = 0;
+
+			if (this->pMapping != nullptr)
+				UnmapFile(this->pMapping, this->mappingSize);
+
+			this->pMapping = nullptr;
+			this->mappingSize = 0;
+
+			if (this->fileDescriptor >= 0)
+				CloseFile(this->fileDescriptor);
+
+			this->fileDescriptor = -1;
+
+			for (auto& it : this->dictionaries)
+				MemoryManager::GetInstance().Free(it.second);
+
+			this->dictionaries.clear();
+			this->sharedEntries.clear();
+
+			for (LooseEntry& entry : this->looseEntries)
+			{
+				if (entry.pData != nullptr)
+					MemoryManager::GetInstance().Free(entry.pData);
+			}
+
+			this->looseEntries.clear();
+			this->importer = nullptr;
+			this->mountPath.clear();
+			this->priority = PACKAGE_BASE_PRIORITY;
 		}
 
+		std::string mountPath;
+		int32_t priority;
 		std::string filename;
 		std::ifstream* pFileStream;
 		bool isPackageOpen;
 		PackageMode packageMode;
-		std::unordered_map<size_t, PackageEntryDescriptor> table;
+		void* pTable;
+		const PackageRecord* pRecords;
+		size_t numRecords;
+		const PackageSourceInfo* pSources;
+		const uint64_t* pDependencies;
+		const char* pStrings;
+		const uint32_t* pBlocks;
+		size_t numBlocks;
+		size_t blockSize;
+		void* pMapping;
+		size_t mappingSize;
+		int fileDescriptor;
+		std::unordered_map<uint64_t, void*> dictionaries;
+		//Offset -> hashes of the entries that point at the same stored data, only offsets with more than one entry
+		std::unordered_map<uint64_t, std::vector<uint64_t>> sharedEntries;
+		//Only used by MOUNT_DIRECTORY, one entry per record
+		DirectoryImporter importer;
+		std::vector<LooseEntry> looseEntries;
+		std::mutex importLock;
 
 		union
 		{
@@ -123,34 +388,219 @@ private:
 		};
 	};
 
+	//Neighbouring entries of a batch that are read from the file at once
+	struct PackageSpan
+	{
+		Package* pPackage;
+		size_t position;
+		size_t size;
+		size_t firstRead;
+		size_t readCount;
+	};
+
+	//Where a GUID is read from, the mount with the highest priority that has it
+	struct MountedEntry
+	{
+		Package* pPackage;
+		const PackageRecord* pRecord;
+	};
+
+	//Never changed once published, mounting and unmounting publish a new one. A read keeps the index it looked the entry up
+	//in alive, and with it the packages, so an unmounted package is destroyed once the last read of it is done
+	struct MountIndex
+	{
+		std::vector<std::shared_ptr<Package>> mounts;
+		std::unordered_map<uint64_t, MountedEntry> entries;
+
+		const MountedEntry* Find(size_t hash) const
+		{
+			auto it = entries.find(hash);
+			return it != entries.end() ? &it->second : nullptr;
+		}
+	};
+
 public:
 	~Archiver();
 
+	//Mounts the package at PACKAGE_BASE_PRIORITY, does nothing if it is mounted already
 	void OpenCompressedPackage(const std::string& filename, PackageMode packageMode);
-	void CloseCompressedPackage();
+	//Entries of a mount override those with the same GUID in mounts of a lower priority, a later mount of the same priority
+	//overrides earlier ones. Every mount keeps its own mode. Mounting and unmounting may overlap reads, a read that is
+	//already running finishes with the mounts it started with.
+	//Returns false if the package cannot be read, it stays mounted without entries
+	bool MountPackage(const std::string& filename, PackageMode packageMode, int32_t priority);
+	//Meant for development, the files are read with the importer the first time they are used
+	bool MountDirectory(const std::string& directory, const std::vector<LooseFile>& files, int32_t priority, const DirectoryImporter& importer);
+	//Takes the filename or directory the package was mounted with
+	bool Unmount(const std::string& path);
+	void UnmountAll();
+	bool IsMounted(const std::string& path);
+	//Returns UNDEFINED if nothing is mounted under the path
+	PackageMode GetPackageMode(const std::string& path);
 
 	size_t ReadRequiredSizeForPackageData(size_t hash);
 	bool ReadPackageData(size_t hash, size_t& typeHash, void* pBuf, size_t bufSize);
+	//Decompresses only the first size bytes of the entry, enough for a loader to read a header
+	bool ReadPackageDataPrefix(size_t hash, size_t& typeHash, void* pBuf, size_t size);
+	//Decodes the entry in windows of PACKAGE_STREAM_WINDOW_SIZE bytes and hands them to the sink, so the memory it needs does
+	//not grow with the entry. LZ4 can only decode whole blocks, which bounds those entries by the block size instead.
+	//Returns false if the entry cannot be read or the sink stopped it, the sink may have been given part of the entry by then
+	bool ReadPackageDataStreamed(size_t hash, size_t& typeHash, const PackageSink& sink);
+	//Points into the package for entries that are stored uncompressed in a mapped package, valid until the package is unmounted
+	bool GetPackageDataView(size_t hash, size_t& typeHash, const void*& pData, size_t& size);
+	bool HasPackageEntry(size_t hash);
+	size_t GetPackageEntryType(size_t hash);
+	std::string GetPackageEntryName(size_t hash);
+	bool GetPackageEntryDependencies(size_t hash, std::vector<size_t>& dependencies);
+	//Entries of the same type with identical content are stored once, the first of them by hash is the canonical one.
+	//Returns the hash itself for entries whose content is not shared
+	size_t GetPackageEntryCanonical(size_t hash);
+	//Appends the other entries of the same type that share the content of the entry
+	bool GetPackageEntryAliases(size_t hash, std::vector<size_t>& aliases);
+	//Reads on the I/O thread, typeHash and pBuf has to stay valid until the task is finished. No worker is held while the
+	//read waits on the disk
+	AsyncTask<bool> ReadPackageDataAsync(size_t hash, size_t& typeHash, void* pBuf, size_t bufSize);
+	//Reads all entries with up to ARCHIVER_IO_QUEUE_DEPTH reads in flight, compressed entries are decompressed on the workers
+	//as their reads complete. Uses io_uring for LOAD_AND_PREPARE packages where it is available and pread or the
+	//mapping otherwise, entries that are close together in the file are read at once. Blocks until every read is finished,
+	//isRead and typeHash are filled in per read
+	void ReadPackageDataBatch(PackageRead* pReads, size_t count);
+	//co_await runs ReadPackageDataBatch on the I/O thread instead of the awaiting worker, the reads have to stay valid until it resumes
+	inline PackageBatchAwaiter ReadPackageDataBatchAsync(PackageRead* pReads, size_t count)
+	{
+		return PackageBatchAwaiter{ this, pReads, count };
+	}
+
+	//Records the order in which entries are first read, starting a recording drops the previous one
+	void SetAccessRecording(bool isRecording);
+	void GetAccessOrder(std::vector<size_t>& order);
 
 	void CreateUncompressedPackage();
+	//Codec for entries of the type, has to be set before they are added. Entries that do not shrink are stored as is
+	void SetPackageCodec(size_t typeHash, PackageCodec codec);
+	//The listed entries are written first in the given order and the rest follow in hash order, so entries that are
+	//loaded together can be read sequentially. Only changes where the data is, the records stay sorted by hash
+	void SetPackageEntryOrder(const std::vector<size_t>& hashes);
 	void AddToUncompressedPackage(size_t hash, size_t typeHash, size_t sizeInBytes, void* pData);
+	//Has to be called after the entry has been added
+	void SetUncompressedPackageEntryInfo(size_t hash, const std::string& name, const std::vector<size_t>& dependencies);
+	//Has to be called after the entry has been added, the source is kept in the package for the next incremental build
+	void SetUncompressedPackageEntrySource(size_t hash, const PackageSourceInfo& source);
 	void RemoveFromUncompressedPackage(size_t hash);
+	//Compresses the entries on the workers and streams them to the file in the entry order,
+	//entries with identical content are compressed and written only once
 	void SaveUncompressedPackage(const std::string& filename);
 	void CloseUncompressedPackage();
 
-	void* DecompressHeader(std::ifstream& fileStream);
+	//Loads the table of an earlier build of the package that unchanged entries can be copied from, returns false
+	//if there is none or it cannot be reused. It is only read from while entries are added, so it can be overwritten
+	bool OpenPreviousPackage(const std::string& filename);
+	void ClosePreviousPackage();
+	bool GetPreviousPackageSource(size_t hash, PackageSourceInfo& source);
+	//Adds the entry exactly as it is stored in the previous package, along with the dictionary it was compressed with.
+	//Returns false if the entry has to be built again
+	bool AddFromPreviousPackage(size_t hash, const PackageSourceInfo& source);
+
+	//Returns nullptr if the file is not a package of the current version
+	void* DecompressHeader(std::ifstream& fileStream, size_t& headerSize, const std::string& filename);
 	size_t CompressHeader(void* pHeader, size_t headerSize, void* pBuf, size_t bufSize);
 
+	//Returns 0 if the data does not fit in bufSize, the dictionary is only used by CODEC_DEFLATE_DICTIONARY
+	static size_t CompressData(PackageCodec codec, const void* pData, size_t size, void* pBuf, size_t bufSize, const void* pDictionary = nullptr, size_t dictionarySize = 0);
+	static bool DecompressData(PackageCodec codec, const void* pCompressed, size_t compressedSize, void* pBuf, size_t uncompressedSize, const void* pDictionary = nullptr, size_t dictionarySize = 0);
+	//Collects the runs that most samples share into a preset dictionary of at most dictionarySize bytes,
+	//returns an empty dictionary if the samples have nothing in common
+	static std::string TrainDictionary(const std::vector<std::pair<const void*, size_t>>& samples, size_t dictionarySize);
+
 private:
 	Archiver();
-	size_t ReadPackageHeader(std::ifstream& fileStream);
+	size_t ReadPackageHeader(Package& package, std::ifstream& fileStream);
+	static bool IsPackageRecordValid(const PackageTableInfo& info, const PackageRecord& record, const uint32_t* pBlocks);
+	static const PackageRecord* FindPackageRecord(const Package& package, size_t hash);
+	bool ReadPreviousEntry(const PackageRecord* pRecord, UncompressedPackageEntry& entry);
+	//Have to be called with m_OpenPackageLock held
+	Package* FindMount(const std::string& path) const;
+	void AddMount(std::shared_ptr<Package> pPackage);
+	void PublishMountIndex();
+	//The index that was current when it is called, it stays valid for as long as it is kept
+	std::shared_ptr<const MountIndex> GetMountIndex();
+	static bool IsSharedWith(const MountIndex& index, const MountedEntry* pEntry, uint64_t sharedHash);
+	bool ReadPackageData(Package& package, const PackageRecord* pRecord, size_t& typeHash, void* pBuf, size_t bufSize);
+	//Imports the loose file if it has not been, or if isDataNeeded and its data has been consumed, then calls func with the entry
+	template<typename Func>
+	bool AccessLooseEntry(Package& package, const PackageRecord* pRecord, bool isDataNeeded, Func func);
+	bool MapPackage(Package& package);
+	static void UnmapFile(void* pMapping, size_t size);
+	static bool ReadFileAt(int fileDescriptor, void* pBuf, size_t size, size_t position);
+	static void CloseFile(int fileDescriptor);
+	static size_t DeflateEntry(const void* pData, size_t size, void* pBuf, size_t bufSize, int level, const void* pDictionary, size_t dictionarySize);
+	static bool InflateEntry(const void* pCompressed, size_t compressedSize, void* pBuf, size_t uncompressedSize, const void* pDictionary, size_t dictionarySize, bool isPrefix);
+	//Reads size stored bytes of the entry from offset on in any package mode
+	bool ReadStoredData(Package& package, const PackageRecord* pRecord, size_t offset, void* pBuf, size_t size);
+	//Returns nullptr unless the package keeps its data section in memory
+	static const char* GetStoredData(const Package& package, const PackageRecord* pRecord);
+	bool ReadPackageDataStreamed(Package& package, const PackageRecord* pRecord, const PackageSink& sink);
+	//Hands the stored bytes to consume a window at a time, straight from memory where the package keeps its data there
+	bool StreamStoredData(Package& package, const PackageRecord* pRecord, size_t offset, size_t size, void* pWindow, const PackageSink& consume);
+	//Decodes one compressed stream of the entry, an entry that is not split into blocks or a single block of one
+	bool StreamDecode(Package& package, const PackageRecord* pRecord, size_t offset, size_t storedSize, size_t size, const PackageSink& sink);
+	bool GetRecordDictionary(Package& package, const PackageRecord* pRecord, const void*& pDictionary, size_t& dictionarySize);
+	//Returns 0 if the blocks together do not shrink, blockSizes gets the stored size of every block
+	static size_t CompressBlocks(PackageCodec codec, const void* pData, size_t size, void* pBuf, const void* pDictionary, size_t dictionarySize, std::vector<uint32_t>& blockSizes);
+	bool DecompressRecord(Package& package, const PackageRecord* pRecord, const void* pCompressed, void* pBuf);
+	//Loaded on first use and kept until the package is unmounted
+	const void* GetDictionary(Package& package, uint64_t hash, size_t& size);
+	void TrainPackageDictionaries();
+	bool InitIoUring();
+	void QueueBatch(PackageRead* pReads, size_t count, std::coroutine_handle<> handle);
+	void IoThread();
+	void RecordAccess(size_t hash);
+	//Sorts the reads by position and merges neighbours into spans, only takes reads of LOAD_AND_PREPARE packages with a file descriptor
+	void PlanPackageSpans(const MountIndex& index, PackageRead* pReads, std::vector<size_t>& readIndices, std::vector<PackageSpan>& spans);
+	void ReadPackageSpan(const MountIndex& index, PackageRead* pReads, const std::vector<size_t>& readIndices, const PackageSpan& span);
+	void FinishPackageSpan(const MountIndex& index, PackageRead* pReads, const std::vector<size_t>& readIndices, const PackageSpan& span, const void* pSpanData);
+	//Spans the ring cannot read, because io_uring is not available or failed, are added to unreadSpans for pread
+	void ReadPackageSpansIoUring(const MountIndex& index, PackageRead* pReads, const std::vector<size_t>& readIndices, const std::vector<PackageSpan>& spans, std::vector<size_t>& unreadSpans);
 
 private:
-	Package m_CompressedPackage;
+	//Sorted by priority and only touched with m_OpenPackageLock held, readers go through the published index that maps
+	//every GUID to the mount it is read from
+	std::vector<std::shared_ptr<Package>> m_Mounts;
+	std::shared_ptr<const MountIndex> m_pMountIndex;
+	SpinLock m_MountIndexLock;
+	Package m_PreviousPackage;
 	std::map<size_t, UncompressedPackageEntry> m_UncompressedPackageEntries;
+	std::unordered_map<size_t, PackageCodec> m_PackageCodecs;
+	std::vector<size_t> m_PackageEntryOrder;
+
+	std::atomic<bool> m_IsRecordingAccess;
+	std::vector<size_t> m_AccessOrder;
+	std::unordered_set<size_t> m_RecordedAccesses;
+	SpinLock m_AccessLock;
 
 	SpinLock m_OpenPackageLock;
 	SpinLock m_FileStreamLock;
+	SpinLock m_DictionaryLock;
+
+	//The ring has a single submitter, a batch holds the lock while it waits on the disk so it is not a SpinLock.
+	//It is never held while running other tasks, those may batch reads themselves
+	IoUring m_IoUring;
+	std::mutex m_IoUringLock;
+	bool m_IsIoUringChecked;
+
+	//Batches awaited by coroutines, run one after another on a thread of their own that is started on first use
+	struct QueuedBatch
+	{
+		PackageRead* pReads;
+		size_t count;
+		std::coroutine_handle<> handle;
+	};
+
+	std::thread m_IoThread;
+	std::queue<QueuedBatch> m_IoQueue;
+	std::mutex m_IoQueueLock;
+	std::condition_variable m_IoQueueCondition;
+	bool m_IsIoThreadStopping;
 
 public:
 	static Archiver& GetInstance()
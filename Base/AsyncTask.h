@@ -0,0 +1,175 @@
+#pragma once
+#include <coroutine>
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include "TaskManager.h"
+
+//Coroutine that does not start until it is awaited, started or waited on. The result is returned by co_await or Wait().
+template<typename T>
+class AsyncTask
+{
+public:
+	struct promise_type
+	{
+		struct FinalAwaiter
+		{
+			inline bool await_ready() const noexcept
+			{
+				return false;
+			}
+
+			inline std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+			{
+				//Read everything we need before signaling, a waiting thread may destroy the frame right after
+				std::coroutine_handle<> continuation = handle.promise().continuation;
+				handle.promise().pending.store(0, std::memory_order_release);
+				
+				if (continuation)
+					return continuation;
+
+				return std::noop_coroutine();
+			}
+
+			inline void await_resume() const noexcept
+			{
+			}
+		};
+
+		inline AsyncTask get_return_object() noexcept
+		{
+			return AsyncTask(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+
+		inline std::suspend_always initial_suspend() const noexcept
+		{
+			return {};
+		}
+
+		inline FinalAwaiter final_suspend() const noexcept
+		{
+			return {};
+		}
+
+		inline void return_value(T result)
+		{
+			value = std::move(result);
+		}
+
+		inline void unhandled_exception() const noexcept
+		{
+			std::terminate();
+		}
+
+		T value = T();
+		std::coroutine_handle<> continuation = nullptr;
+		std::atomic<size_t> pending = 1;
+	};
+
+public:
+	AsyncTask(const AsyncTask& other) = delete;
+	AsyncTask& operator=(const AsyncTask& other) = delete;
+	AsyncTask& operator=(AsyncTask&& other) = delete;
+
+	inline AsyncTask(AsyncTask&& other) noexcept
+		: m_Handle(other.m_Handle),
+		m_Started(other.m_Started)
+	{
+		other.m_Handle = nullptr;
+	}
+
+	inline ~AsyncTask()
+	{
+		if (m_Handle)
+		{
+			//The frame may not be destroyed while it is still running
+			assert(!m_Started || IsFinished());
+			m_Handle.destroy();
+		}
+	}
+
+	//Runs the coroutine on the calling thread until it suspends for the first time
+	inline void Start()
+	{
+		assert(!m_Started);
+		m_Started = true;
+		m_Handle.resume();
+	}
+
+	inline bool IsFinished() const
+	{
+		return m_Handle.promise().pending.load(std::memory_order_acquire) == 0;
+	}
+
+	//Blocks until the coroutine has finished, queued tasks are executed on the calling thread meanwhile
+	inline T Wait()
+	{
+		if (!m_Started)
+			Start();
+
+		TaskManager::Get().WaitForCounter(m_Handle.promise().pending);
+		return std::move(m_Handle.promise().value);
+	}
+
+	inline bool await_ready() const noexcept
+	{
+		return false;
+	}
+
+	inline std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaitingCoroutine) noexcept
+	{
+		//A started task could finish before the continuation is set
+		assert(!m_Started);
+		m_Started = true;
+
+		m_Handle.promise().continuation = awaitingCoroutine;
+		return m_Handle;
+	}
+
+	inline T await_resume()
+	{
+		return std::move(m_Handle.promise().value);
+	}
+
+private:
+	inline explicit AsyncTask(std::coroutine_handle<promise_type> handle)
+		: m_Handle(handle),
+		m_Started(false)
+	{
+	}
+
+private:
+	std::coroutine_handle<promise_type> m_Handle;
+	bool m_Started;
+};
+
+//Coroutine that starts directly and destroys itself when it is done, nobody can wait for it
+struct DetachedTask
+{
+	struct promise_type
+	{
+		inline DetachedTask get_return_object() const noexcept
+		{
+			return {};
+		}
+
+		inline std::suspend_never initial_suspend() const noexcept
+		{
+			return {};
+		}
+
+		inline std::suspend_never final_suspend() const noexcept
+		{
+			return {};
+		}
+
+		inline void return_void() const noexcept
+		{
+		}
+
+		inline void unhandled_exception() const noexcept
+		{
+			std::terminate();
+		}
+	};
+};
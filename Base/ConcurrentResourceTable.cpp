@@ -0,0 +1,238 @@
+#include "ConcurrentResourceTable.h"
+#include "MemoryManager.h"
+#include <cassert>
+#include <new>
+#include <thread>
+
+ConcurrentResourceTable::ConcurrentResourceTable(size_t initialCapacity)
+	: m_pTable(nullptr),
+	m_Version(0),
+	m_Size(0),
+	m_UsedSlots(0)
+{
+	//The capacity has to be a power of two so the probe can wrap with a mask
+	size_t capacity = 16;
+	while (capacity < initialCapacity)
+		capacity *= 2;
+
+	m_pTable.store(CreateTable(capacity), std::memory_order_release);
+}
+
+ConcurrentResourceTable::~ConcurrentResourceTable()
+{
+	Table* pTable = m_pTable.load(std::memory_order_acquire);
+	while (pTable)
+	{
+		Table* pRetired = pTable->pRetired;
+		DestroyTable(pTable);
+		pTable = pRetired;
+	}
+}
+
+IResource* ConcurrentResourceTable::Find(size_t guid) const
+{
+	for (;;)
+	{
+		//An odd version means the slots are being compacted and may hand out anything
+		uint32_t version = m_Version.load(std::memory_order_acquire);
+		if (version & 1)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		IResource* resource = nullptr;
+		Table* pTable = m_pTable.load(std::memory_order_acquire);
+		size_t mask = pTable->capacity - 1;
+		for (size_t index = Mix(guid) & mask;; index = (index + 1) & mask)
+		{
+			size_t slotGuid = pTable->pSlots[index].guid.load(std::memory_order_acquire);
+			if (slotGuid == guid)
+			{
+				resource = pTable->pSlots[index].resource.load(std::memory_order_acquire);
+				break;
+			}
+
+			if (slotGuid == RESOURCE_TABLE_EMPTY_GUID)
+				break;
+		}
+
+		//Only trust the probe if no compaction started while it ran
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_Version.load(std::memory_order_relaxed) == version)
+			return resource;
+	}
+}
+
+void ConcurrentResourceTable::Insert(size_t guid, IResource* resource)
+{
+	assert(guid != RESOURCE_TABLE_EMPTY_GUID && resource != nullptr);
+
+	//Keep the load factor below 3/4, counting erased slots since they still lengthen the probes.
+	//Only allocate when the live entries need the room, otherwise dropping the erased slots is enough
+	Table* pTable = m_pTable.load(std::memory_order_relaxed);
+	if ((m_UsedSlots + 1) * 4 > pTable->capacity * 3)
+	{
+		if ((m_Size.load(std::memory_order_relaxed) + 1) * 2 > pTable->capacity)
+			Grow();
+		else
+			Compact();
+
+		pTable = m_pTable.load(std::memory_order_relaxed);
+	}
+
+	size_t mask = pTable->capacity - 1;
+	for (size_t index = Mix(guid) & mask;; index = (index + 1) & mask)
+	{
+		Slot& slot = pTable->pSlots[index];
+		size_t slotGuid = slot.guid.load(std::memory_order_relaxed);
+		if (slotGuid == guid)
+		{
+			if (!slot.resource.exchange(resource, std::memory_order_release))
+				m_Size.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		//The resource is written before the GUID is published so readers never see a half filled slot
+		if (slotGuid == RESOURCE_TABLE_EMPTY_GUID)
+		{
+			slot.resource.store(resource, std::memory_order_relaxed);
+			slot.guid.store(guid, std::memory_order_release);
+			m_Size.fetch_add(1, std::memory_order_relaxed);
+			m_UsedSlots++;
+			return;
+		}
+	}
+}
+
+bool ConcurrentResourceTable::Erase(size_t guid)
+{
+	Table* pTable = m_pTable.load(std::memory_order_relaxed);
+	size_t mask = pTable->capacity - 1;
+	for (size_t index = Mix(guid) & mask;; index = (index + 1) & mask)
+	{
+		Slot& slot = pTable->pSlots[index];
+		size_t slotGuid = slot.guid.load(std::memory_order_relaxed);
+		if (slotGuid == guid)
+		{
+			if (!slot.resource.exchange(nullptr, std::memory_order_release))
+				return false;
+
+			m_Size.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		if (slotGuid == RESOURCE_TABLE_EMPTY_GUID)
+			return false;
+	}
+}
+
+size_t ConcurrentResourceTable::GetSize() const
+{
+	return m_Size.load(std::memory_order_relaxed);
+}
+
+ConcurrentResourceTable::Table* ConcurrentResourceTable::CreateTable(size_t capacity)
+{
+	Table* pTable = new(mm_allocate(sizeof(Table), alignof(Table), "Resource Table")) Table();
+	pTable->capacity = capacity;
+	pTable->pSlots = (Slot*)mm_allocate(sizeof(Slot) * capacity, alignof(Slot), "Resource Table Slots");
+	pTable->pRetired = nullptr;
+	for (size_t i = 0; i < capacity; i++)
+	{
+		new(&pTable->pSlots[i].guid) std::atomic<size_t>(RESOURCE_TABLE_EMPTY_GUID);
+		new(&pTable->pSlots[i].resource) std::atomic<IResource*>(nullptr);
+	}
+
+	return pTable;
+}
+
+void ConcurrentResourceTable::DestroyTable(Table* pTable)
+{
+	mm_free(pTable->pSlots);
+	mm_free(pTable);
+}
+
+size_t ConcurrentResourceTable::Mix(size_t guid)
+{
+	//GUIDs are 32 bit string hashes, spread them over the whole word before masking
+	uint64_t hash = guid;
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+	return size_t(hash);
+}
+
+void ConcurrentResourceTable::PlaceSlot(Table* pTable, size_t guid, IResource* resource)
+{
+	size_t mask = pTable->capacity - 1;
+	size_t index = Mix(guid) & mask;
+	while (pTable->pSlots[index].guid.load(std::memory_order_relaxed) != RESOURCE_TABLE_EMPTY_GUID)
+		index = (index + 1) & mask;
+
+	pTable->pSlots[index].resource.store(resource, std::memory_order_relaxed);
+	pTable->pSlots[index].guid.store(guid, std::memory_order_relaxed);
+}
+
+void ConcurrentResourceTable::Grow()
+{
+	Table* pOld = m_pTable.load(std::memory_order_relaxed);
+	Table* pNew = CreateTable(pOld->capacity * 2);
+
+	m_UsedSlots = 0;
+	for (size_t i = 0; i < pOld->capacity; i++)
+	{
+		IResource* resource = pOld->pSlots[i].resource.load(std::memory_order_relaxed);
+		if (!resource)
+			continue;
+
+		PlaceSlot(pNew, pOld->pSlots[i].guid.load(std::memory_order_relaxed), resource);
+		m_UsedSlots++;
+	}
+
+	pNew->pRetired = pOld;
+	m_pTable.store(pNew, std::memory_order_release);
+}
+
+void ConcurrentResourceTable::Compact()
+{
+	Table* pTable = m_pTable.load(std::memory_order_relaxed);
+	size_t mask = pTable->capacity - 1;
+
+	//Readers that overlap the odd version throw their probe away and try again
+	uint32_t version = m_Version.load(std::memory_order_relaxed);
+	m_Version.store(version + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	//Empty every erased slot, then reinsert the live entries cluster by cluster starting after an empty slot,
+	//so every entry lands at or before its old position along its own probe chain
+	size_t start = 0;
+	for (size_t i = 0; i < pTable->capacity; i++)
+	{
+		Slot& slot = pTable->pSlots[i];
+		if (slot.resource.load(std::memory_order_relaxed))
+			continue;
+
+		slot.guid.store(RESOURCE_TABLE_EMPTY_GUID, std::memory_order_relaxed);
+		start = i;
+	}
+
+	m_UsedSlots = 0;
+	for (size_t i = 1; i <= pTable->capacity; i++)
+	{
+		Slot& slot = pTable->pSlots[(start + i) & mask];
+		IResource* resource = slot.resource.load(std::memory_order_relaxed);
+		if (!resource)
+			continue;
+
+		size_t guid = slot.guid.load(std::memory_order_relaxed);
+		slot.guid.store(RESOURCE_TABLE_EMPTY_GUID, std::memory_order_relaxed);
+		slot.resource.store(nullptr, std::memory_order_relaxed);
+		PlaceSlot(pTable, guid, resource);
+		m_UsedSlots++;
+	}
+
+	m_Version.store(version + 2, std::memory_order_release);
+}
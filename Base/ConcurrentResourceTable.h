@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+#define RESOURCE_TABLE_INITIAL_CAPACITY 256
+#define RESOURCE_TABLE_EMPTY_GUID 0
+
+class IResource;
+
+//Open addressing GUID -> resource table with linear probing. Find takes no lock and can run concurrently with a writer,
+//Insert and Erase have to be serialized by the owner. Erased slots keep their GUID so probe chains stay intact,
+//and once they fill the table they are cleaned in place while readers retry, see Compact. Tables that have been
+//outgrown are kept until the table is destroyed since readers may still be probing them, each one is half the
+//size of the next so they never add up to more than the live table.
+class ConcurrentResourceTable
+{
+	struct Slot
+	{
+		std::atomic<size_t> guid;
+		std::atomic<IResource*> resource;
+	};
+
+	struct Table
+	{
+		size_t capacity;
+		Slot* pSlots;
+		Table* pRetired;
+	};
+
+public:
+	ConcurrentResourceTable(size_t initialCapacity = RESOURCE_TABLE_INITIAL_CAPACITY);
+	~ConcurrentResourceTable();
+
+	IResource* Find(size_t guid) const;
+
+	void Insert(size_t guid, IResource* resource);
+	bool Erase(size_t guid);
+
+	size_t GetSize() const;
+
+	//Has to be serialized with the writers
+	template<typename Func>
+	void ForEach(Func func) const
+	{
+		Table* pTable = m_pTable.load(std::memory_order_acquire);
+		for (size_t i = 0; i < pTable->capacity; i++)
+		{
+			IResource* resource = pTable->pSlots[i].resource.load(std::memory_order_relaxed);
+			if (resource)
+				func(pTable->pSlots[i].guid.load(std::memory_order_relaxed), resource);
+		}
+	}
+
+private:
+	static Table* CreateTable(size_t capacity);
+	static void DestroyTable(Table* pTable);
+	static size_t Mix(size_t guid);
+	static void PlaceSlot(Table* pTable, size_t guid, IResource* resource);
+	void Grow();
+	void Compact();
+
+	std::atomic<Table*> m_pTable;
+	std::atomic<uint32_t> m_Version;
+	std::atomic<size_t> m_Size;
+	size_t m_UsedSlots;
+};
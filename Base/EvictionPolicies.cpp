@@ -0,0 +1,65 @@
+#include "EvictionPolicies.h"
+#include <algorithm>
+
+void LRUEvictionPolicy::SelectVictims(IResource* pLeastRecent, uint64_t, size_t bytesToFree, std::vector<IResource*>& victims)
+{
+	size_t bytesSelected = 0;
+	for (IResource* pResource = pLeastRecent; pResource && bytesSelected < bytesToFree; pResource = pResource->GetMoreRecent())
+	{
+		if (pResource->InUse())
+			continue;
+
+		victims.push_back(pResource);
+		bytesSelected += pResource->GetSize();
+	}
+}
+
+const char* LRUEvictionPolicy::GetName() const
+{
+	return "LRU";
+}
+
+void ScoredEvictionPolicy::SelectVictims(IResource* pLeastRecent, uint64_t currentTick, size_t bytesToFree, std::vector<IResource*>& victims)
+{
+	std::vector<std::pair<double, IResource*>> candidates;
+	for (IResource* pResource = pLeastRecent; pResource; pResource = pResource->GetMoreRecent())
+	{
+		if (!pResource->InUse())
+			candidates.push_back({ Score(pResource, currentTick), pResource });
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const std::pair<double, IResource*>& a, const std::pair<double, IResource*>& b)
+	{
+		return a.first > b.first;
+	});
+
+	size_t bytesSelected = 0;
+	for (size_t i = 0; i < candidates.size() && bytesSelected < bytesToFree; i++)
+	{
+		victims.push_back(candidates[i].second);
+		bytesSelected += candidates[i].second->GetSize();
+	}
+}
+
+const char* LFUEvictionPolicy::GetName() const
+{
+	return "LFU";
+}
+
+double LFUEvictionPolicy::Score(const IResource* pResource, uint64_t currentTick) const
+{
+	//The age is scaled below one so that it only decides between equal access counts
+	double age = double(currentTick - pResource->GetLastAccess()) / double(currentTick + 1);
+	return age - double(pResource->GetAccessCount());
+}
+
+const char* SizeWeightedEvictionPolicy::GetName() const
+{
+	return "Size weighted";
+}
+
+double SizeWeightedEvictionPolicy::Score(const IResource* pResource, uint64_t currentTick) const
+{
+	double age = double(currentTick - pResource->GetLastAccess() + 1);
+	return double(pResource->GetSize()) * age / double(pResource->GetAccessCount() + 1);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "IEvictionPolicy.h"
+
+//Evicts the least recently used resources first, only walks as far into the recency list as it needs to
+class LRUEvictionPolicy : public IEvictionPolicy
+{
+public:
+	virtual void SelectVictims(IResource* pLeastRecent, uint64_t currentTick, size_t bytesToFree, std::vector<IResource*>& victims) override;
+	virtual const char* GetName() const override;
+};
+
+//Scores every unused resource and evicts the highest scores first
+class ScoredEvictionPolicy : public IEvictionPolicy
+{
+public:
+	virtual void SelectVictims(IResource* pLeastRecent, uint64_t currentTick, size_t bytesToFree, std::vector<IResource*>& victims) override;
+
+protected:
+	virtual double Score(const IResource* pResource, uint64_t currentTick) const = 0;
+};
+
+//Evicts the least frequently used resources first, ties are broken by recency
+class LFUEvictionPolicy : public ScoredEvictionPolicy
+{
+public:
+	virtual const char* GetName() const override;
+
+protected:
+	virtual double Score(const IResource* pResource, uint64_t currentTick) const override;
+};
+
+//Prefers evicting large resources that are rarely and not recently used, so that fewer evictions are needed
+class SizeWeightedEvictionPolicy : public ScoredEvictionPolicy
+{
+public:
+	virtual const char* GetName() const override;
+
+protected:
+	virtual double Score(const IResource* pResource, uint64_t currentTick) const override;
+};
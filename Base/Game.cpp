@@ -8,6 +8,7 @@
 #include "Renderer.h"
 #include "ResourceManager.h"
 #include "ResourceLoader.h"
+#include "TaskManager.h"
 #include "LoaderTGA.h"
 #include "LoaderBMP.h"
 #include "LoaderOBJ.h"
@@ -103,7 +104,14 @@ void Game::Run()
 			}
 		}
 
+		//Run work that other threads have scheduled for the main thread (GPU uploads etc.)
+		TaskManager::Get().ExecuteMainThreadTasks(MAIN_THREAD_TASK_BUDGET_MS);
+		ResourceManager::Get().FinalizeResources(RESOURCE_FINALIZE_BUDGET_MS, RESOURCE_FINALIZE_BUDGET_BYTES);
+
 		InternalUpdate(deltaTime);
+
+		//Start the streaming loads the client requested this frame
+		ResourceManager::Get().UpdateStreaming();
        
 		//Draw customs stuff
 		InternalRender(deltaTime);
@@ -124,7 +132,6 @@ void Game::Run()
 void Game::InternalUpdate(const sf::Time& deltatime)
 {
 	ImGui::SFML::Update(*m_pRenderWindow, deltatime);
-	ResourceManager::Get().Update();
 	Update(deltatime);
     
     //Move camera
@@ -182,6 +189,8 @@ void Game::InternalRenderImGui(const sf::Time& deltatime)
 void Game::InternalRelease()
 {
 	Release();
+	ResourceManager::Get().CancelStreaming();
+	ResourceManager::Get().DisableHotReload();
 
 	ImGui::SFML::Shutdown();
 
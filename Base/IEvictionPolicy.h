@@ -0,0 +1,14 @@
+#pragma once
+#include <vector>
+#include "IResource.h"
+
+class IEvictionPolicy
+{
+public:
+	virtual ~IEvictionPolicy() = default;
+	
+	//Adds resources without references to victims until at least bytesToFree would be released.
+	//The recency list is walked from pLeastRecent towards the most recent resource with IResource::GetMoreRecent().
+	virtual void SelectVictims(IResource* pLeastRecent, uint64_t currentTick, size_t bytesToFree, std::vector<IResource*>& victims) = 0;
+	virtual const char* GetName() const = 0;
+};
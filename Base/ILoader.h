@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <cstdint>
 
 #include "IResource.h"
 
@@ -11,4 +13,19 @@ public:
 	virtual IResource* LoadFromDisk(const std::string& file) = 0;
 	virtual IResource* LoadFromMemory(void* data, size_t size) = 0;
 	virtual size_t WriteToBuffer(const std::string& file, void* buffer) = 0;
+	
+	//Has to be increased whenever WriteToBuffer produces different output, incremental package builds import
+	//every file of the type again when it changes
+	virtual uint32_t GetVersion() { return 1; }
+
+	//Files (relative to the package directory) that has to be loaded before this one, recorded when packaging
+	virtual void GetDependencies(const std::string&, std::vector<std::string>&) {}
+
+	//Loaders that can keep a packaged entry as the resource's own memory report how many leading bytes they need
+	//to size it, 0 means the entry always goes through LoadFromMemory
+	virtual size_t GetStorageHeaderSize() { return 0; }
+	//Allocates the memory the whole entry of size bytes is decompressed into with mm_allocate, nullptr if the header is invalid
+	virtual void* CreateStorage(const void*, size_t) { return nullptr; }
+	//Takes ownership of the storage once it holds the entry
+	virtual IResource* LoadFromStorage(void*, size_t) { return nullptr; }
 };
@@ -6,6 +6,23 @@ IResource::~IResource()
 	ResourceManager::Get().UnloadResource(this);
 }
 
+bool IResource::InitPartial(size_t, size_t& bytesUploaded)
+{
+	Init();
+	bytesUploaded = m_Size;
+	return true;
+}
+
+bool IResource::TakePayload(IResource*)
+{
+	return false;
+}
+
+size_t IResource::GetPayloadSize() const
+{
+	return m_Size;
+}
+
 size_t IResource::GetGUID() const
 {
 	return m_Guid;
@@ -25,3 +42,19 @@ bool IResource::IsReady() const
 {
 	return m_Ready;
 }
+
+
+IResource* IResource::GetMoreRecent() const
+{
+	return m_pMoreRecent;
+}
+
+uint64_t IResource::GetLastAccess() const
+{
+	return m_LastAccess;
+}
+
+uint32_t IResource::GetAccessCount() const
+{
+	return m_AccessCount;
+}
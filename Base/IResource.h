@@ -2,6 +2,7 @@
 #include "Helpers.h"
 #include "IRefCountable.h"
 #include "MemoryManager.h"
+#include <vector>
 
 #ifdef VISUAL_STUDIO
 	#pragma warning(disable : 4291)		//Disable: "no matching operator delete found; memory will not be freed if initialization throws an exception"-warning
@@ -12,7 +13,7 @@ class IResource : public IRefCountable
 	friend class ResourceManager;
 
 public:
-	IResource() : m_Guid(0), m_Size(0), m_Ready(false) {};
+	IResource() : m_Guid(0), m_Size(0), m_Ready(false), m_pMoreRecent(nullptr), m_pLessRecent(nullptr), m_LastAccess(0), m_AccessCount(0) {};
 	virtual ~IResource();
 
 	size_t GetGUID() const;
@@ -21,6 +22,11 @@ public:
 
 	bool IsReady() const;
 
+	//Recency and usage stats maintained by the ResourceManager, used by eviction policies
+	IResource* GetMoreRecent() const;
+	uint64_t GetLastAccess() const;
+	uint32_t GetAccessCount() const;
+
 	inline void* operator new(size_t size, const char* tag)
 	{
 #ifdef SHOW_ALLOCATIONS_DEBUG
@@ -38,6 +44,16 @@ protected:
 	virtual void Init() = 0;
 	virtual void Release() = 0;
 
+	//Uploads roughly maxBytes at a time and returns true once the resource is initialized.
+	//Resources that cannot be split up are initialized in one call.
+	virtual bool InitPartial(size_t maxBytes, size_t& bytesUploaded);
+
+	//Takes the CPU data of a freshly loaded resource of the same type and drops the GPU data, which is recreated by the next Init.
+	//Returns false if the resource cannot be reloaded.
+	virtual bool TakePayload(IResource* pSource);
+	//Bytes of CPU data that was taken, counted like the package entry the resource is loaded from. Only valid until it is uploaded
+	virtual size_t GetPayloadSize() const;
+
 private:
 	inline void InternalInit()
 	{
@@ -46,6 +62,26 @@ private:
 		m_Ready = true;
 	};
 
+	inline bool InternalInitPartial(size_t maxBytes, size_t& bytesUploaded)
+	{
+		bytesUploaded = 0;
+		if (m_Ready)
+			return true;
+
+		m_Ready = InitPartial(maxBytes, bytesUploaded);
+		return m_Ready;
+	};
+
+	//Has to be called on the main thread since the GPU data is released
+	inline bool InternalReload(IResource* pSource)
+	{
+		if (!TakePayload(pSource))
+			return false;
+
+		m_Ready = false;
+		return true;
+	};
+
 	virtual inline void InternalRelease() override
 	{
 		Release();
@@ -57,4 +93,16 @@ private:
 	size_t m_Size;
 	std::string m_Name;
 	bool m_Ready;
+
+	std::vector<size_t> m_Dependencies;
+	//Dependencies this resource took a reference to, only these are released when it is unloaded
+	std::vector<IResource*> m_DependencyRefs;
+	//GUIDs of package entries with the same content, they are looked up as this resource
+	std::vector<size_t> m_Aliases;
+
+	//Intrusive recency list, owned by the ResourceManager
+	IResource* m_pMoreRecent;
+	IResource* m_pLessRecent;
+	uint64_t m_LastAccess;
+	uint32_t m_AccessCount;
 };
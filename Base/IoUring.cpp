@@ -0,0 +1,259 @@
+#include "IoUring.h"
+#include <atomic>
+#include <cstring>
+#include <cassert>
+
+#ifdef __linux__
+	#include <linux/io_uring.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+	#include <cerrno>
+#endif
+
+IoUring::IoUring()
+	: m_RingHandle(-1),
+	m_Entries(0),
+	m_ToSubmit(0),
+	m_pSqRing(nullptr),
+	m_SqRingSize(0),
+	m_pCqRing(nullptr),
+	m_CqRingSize(0),
+	m_pSqes(nullptr),
+	m_SqesSize(0),
+	m_pSqHead(nullptr),
+	m_pSqTail(nullptr),
+	m_pSqArray(nullptr),
+	m_SqMask(0),
+	m_pCqHead(nullptr),
+	m_pCqTail(nullptr),
+	m_pCqes(nullptr),
+	m_CqMask(0)
+{
+}
+
+IoUring::~IoUring()
+{
+	Release();
+}
+
+bool IoUring::IsValid() const
+{
+	return m_RingHandle >= 0;
+}
+
+uint32_t IoUring::GetUnsubmittedCount() const
+{
+	return m_ToSubmit;
+}
+
+#ifdef __linux__
+
+bool IoUring::Init(uint32_t entries)
+{
+	Release();
+
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	//Fails with ENOSYS on old kernels and EPERM where io_uring has been disabled
+	int ringHandle = int(syscall(__NR_io_uring_setup, entries, &params));
+	if (ringHandle < 0)
+		return false;
+
+	m_RingHandle = ringHandle;
+	m_Entries = params.sq_entries;
+	m_SqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	m_CqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+	//Newer kernels put both rings in one mapping
+	bool isSingleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (isSingleMapping)
+	{
+		m_SqRingSize = m_SqRingSize > m_CqRingSize ? m_SqRingSize : m_CqRingSize;
+		m_CqRingSize = 0;
+	}
+
+	m_pSqRing = mmap(nullptr, m_SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringHandle, IORING_OFF_SQ_RING);
+	if (m_pSqRing == MAP_FAILED)
+	{
+		m_pSqRing = nullptr;
+		Release();
+		return false;
+	}
+
+	if (isSingleMapping)
+	{
+		m_pCqRing = m_pSqRing;
+	}
+	else
+	{
+		m_pCqRing = mmap(nullptr, m_CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringHandle, IORING_OFF_CQ_RING);
+		if (m_pCqRing == MAP_FAILED)
+		{
+			m_pCqRing = nullptr;
+			Release();
+			return false;
+		}
+	}
+
+	m_SqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	m_pSqes = mmap(nullptr, m_SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringHandle, IORING_OFF_SQES);
+	if (m_pSqes == MAP_FAILED)
+	{
+		m_pSqes = nullptr;
+		Release();
+		return false;
+	}
+
+	char* pSqRing = reinterpret_cast<char*>(m_pSqRing);
+	m_pSqHead = reinterpret_cast<uint32_t*>(pSqRing + params.sq_off.head);
+	m_pSqTail = reinterpret_cast<uint32_t*>(pSqRing + params.sq_off.tail);
+	m_pSqArray = reinterpret_cast<uint32_t*>(pSqRing + params.sq_off.array);
+	m_SqMask = *reinterpret_cast<uint32_t*>(pSqRing + params.sq_off.ring_mask);
+
+	char* pCqRing = reinterpret_cast<char*>(m_pCqRing);
+	m_pCqHead = reinterpret_cast<uint32_t*>(pCqRing + params.cq_off.head);
+	m_pCqTail = reinterpret_cast<uint32_t*>(pCqRing + params.cq_off.tail);
+	m_pCqes = pCqRing + params.cq_off.cqes;
+	m_CqMask = *reinterpret_cast<uint32_t*>(pCqRing + params.cq_off.ring_mask);
+
+	return true;
+}
+
+void IoUring::Release()
+{
+	if (m_pSqes != nullptr)
+		munmap(m_pSqes, m_SqesSize);
+
+	if (m_pCqRing != nullptr && m_pCqRing != m_pSqRing)
+		munmap(m_pCqRing, m_CqRingSize);
+
+	if (m_pSqRing != nullptr)
+		munmap(m_pSqRing, m_SqRingSize);
+
+	if (m_RingHandle >= 0)
+		close(m_RingHandle);
+
+	m_RingHandle = -1;
+	m_Entries = 0;
+	m_ToSubmit = 0;
+	m_pSqRing = nullptr;
+	m_pCqRing = nullptr;
+	m_pSqes = nullptr;
+}
+
+bool IoUring::PrepareRead(int fileDescriptor, void* pBuf, uint32_t size, uint64_t position, uint64_t userData)
+{
+	assert(IsValid());
+
+	//Only this thread writes the tail, the kernel moves the head as it consumes entries
+	uint32_t tail = *m_pSqTail;
+	uint32_t head = std::atomic_ref<uint32_t>(*m_pSqHead).load(std::memory_order_acquire);
+	if (tail - head >= m_Entries)
+		return false;
+
+	uint32_t index = tail & m_SqMask;
+	io_uring_sqe* pSqe = reinterpret_cast<io_uring_sqe*>(m_pSqes) + index;
+	memset(pSqe, 0, sizeof(io_uring_sqe));
+	pSqe->opcode = IORING_OP_READ;
+	pSqe->fd = fileDescriptor;
+	pSqe->addr = reinterpret_cast<uint64_t>(pBuf);
+	pSqe->len = size;
+	pSqe->off = position;
+	pSqe->user_data = userData;
+	m_pSqArray[index] = index;
+
+	//The entry has to be visible before the kernel sees the new tail
+	std::atomic_ref<uint32_t>(*m_pSqTail).store(tail + 1, std::memory_order_release);
+	m_ToSubmit++;
+
+	return true;
+}
+
+bool IoUring::Submit(uint32_t minComplete)
+{
+	assert(IsValid());
+
+	for (;;)
+	{
+		unsigned int flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+		int submitted = int(syscall(__NR_io_uring_enter, m_RingHandle, m_ToSubmit, minComplete, flags, nullptr, 0));
+		if (submitted < 0)
+		{
+			//EAGAIN and EBUSY mean the completion queue has to be drained before more can be submitted
+			if (errno == EINTR)
+				continue;
+
+			return errno == EAGAIN || errno == EBUSY;
+		}
+
+		m_ToSubmit -= uint32_t(submitted);
+		return true;
+	}
+}
+
+bool IoUring::Wait(uint32_t minComplete)
+{
+	assert(IsValid());
+
+	for (;;)
+	{
+		int result = int(syscall(__NR_io_uring_enter, m_RingHandle, 0, minComplete, IORING_ENTER_GETEVENTS, nullptr, 0));
+		if (result < 0 && errno == EINTR)
+			continue;
+
+		return result >= 0;
+	}
+}
+
+bool IoUring::PopCompletion(uint64_t& userData, int32_t& result)
+{
+	assert(IsValid());
+
+	//Only this thread writes the head, the kernel moves the tail as reads finish
+	uint32_t head = *m_pCqHead;
+	uint32_t tail = std::atomic_ref<uint32_t>(*m_pCqTail).load(std::memory_order_acquire);
+	if (head == tail)
+		return false;
+
+	io_uring_cqe* pCqe = reinterpret_cast<io_uring_cqe*>(m_pCqes) + (head & m_CqMask);
+	userData = pCqe->user_data;
+	result = pCqe->res;
+
+	std::atomic_ref<uint32_t>(*m_pCqHead).store(head + 1, std::memory_order_release);
+	return true;
+}
+
+#else
+
+bool IoUring::Init(uint32_t)
+{
+	return false;
+}
+
+void IoUring::Release()
+{
+}
+
+bool IoUring::PrepareRead(int, void*, uint32_t, uint64_t, uint64_t)
+{
+	return false;
+}
+
+bool IoUring::Submit(uint32_t)
+{
+	return false;
+}
+
+bool IoUring::Wait(uint32_t)
+{
+	return false;
+}
+
+bool IoUring::PopCompletion(uint64_t&, int32_t&)
+{
+	return false;
+}
+
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+//Minimal io_uring submission/completion ring for file reads, set up through the raw system calls.
+//Init fails on platforms and kernels without io_uring, callers are expected to fall back to pread.
+//A ring is not thread safe, a single thread has to do all the submitting and reaping.
+class IoUring
+{
+public:
+	IoUring();
+	~IoUring();
+
+	bool Init(uint32_t entries);
+	void Release();
+	bool IsValid() const;
+
+	//Returns false if the submission queue is full
+	bool PrepareRead(int fileDescriptor, void* pBuf, uint32_t size, uint64_t position, uint64_t userData);
+	//Submits the prepared reads and blocks until at least minComplete of the submitted reads are finished
+	bool Submit(uint32_t minComplete);
+	//Blocks until at least minComplete reads are finished without submitting anything
+	bool Wait(uint32_t minComplete);
+	//Prepared reads the kernel has not taken yet, they are the most recently prepared ones
+	uint32_t GetUnsubmittedCount() const;
+	//Returns false if no completion is ready, result is the number of bytes read or a negated errno
+	bool PopCompletion(uint64_t& userData, int32_t& result);
+
+private:
+	int m_RingHandle;
+	uint32_t m_Entries;
+	uint32_t m_ToSubmit;
+
+	void* m_pSqRing;
+	size_t m_SqRingSize;
+	void* m_pCqRing;
+	size_t m_CqRingSize;
+	void* m_pSqes;
+	size_t m_SqesSize;
+
+	uint32_t* m_pSqHead;
+	uint32_t* m_pSqTail;
+	uint32_t* m_pSqArray;
+	uint32_t m_SqMask;
+	uint32_t* m_pCqHead;
+	uint32_t* m_pCqTail;
+	void* m_pCqes;
+	uint32_t m_CqMask;
+};
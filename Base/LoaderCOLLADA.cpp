@@ -80,6 +80,24 @@ size_t LoaderCOLLADA::WriteToBuffer(const std::string& file, void* buffer)
 }
 
 
+size_t LoaderCOLLADA::GetStorageHeaderSize()
+{
+    return sizeof(BinaryMeshData);
+}
+
+
+void* LoaderCOLLADA::CreateStorage(const void* pHeader, size_t size)
+{
+    return Mesh::CreateStorage(pHeader, size);
+}
+
+
+IResource* LoaderCOLLADA::LoadFromStorage(void* pStorage, size_t size)
+{
+    return Mesh::CreateFromStorage(pStorage, size);
+}
+
+
 
 template<typename T>
 struct TArray
@@ -9,6 +9,9 @@ public:
 	virtual IResource* LoadFromDisk(const std::string& file) override;
 	virtual IResource* LoadFromMemory(void* data, size_t size) override;
 	virtual size_t WriteToBuffer(const std::string& file, void* buffer) override;
+	virtual size_t GetStorageHeaderSize() override;
+	virtual void* CreateStorage(const void* pHeader, size_t size) override;
+	virtual IResource* LoadFromStorage(void* pStorage, size_t size) override;
 public:
 	static MeshData ReadFromDisk(const std::string& filepath);
 };
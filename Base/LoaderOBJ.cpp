@@ -123,6 +123,24 @@ size_t LoaderOBJ::WriteToBuffer(const std::string& file, void* buffer)
 }
 
 
+size_t LoaderOBJ::GetStorageHeaderSize()
+{
+    return sizeof(BinaryMeshData);
+}
+
+
+void* LoaderOBJ::CreateStorage(const void* pHeader, size_t size)
+{
+    return Mesh::CreateStorage(pHeader, size);
+}
+
+
+IResource* LoaderOBJ::LoadFromStorage(void* pStorage, size_t size)
+{
+    return Mesh::CreateFromStorage(pStorage, size);
+}
+
+
 std::vector<MeshData> LoaderOBJ::ReadFromDisk(const std::string& filepath)
 {
 	std::vector<MeshData> meshes;
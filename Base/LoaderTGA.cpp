@@ -2,6 +2,7 @@
 #include "Helpers.h"
 #include "PoolAllocator.h"
 #include "StackAllocator.h"
+#include "TaskManager.h"
 
 #define INVERTED_BIT (1 << 5)
 #define BYTE32 32
@@ -122,9 +123,10 @@ void LoaderTGA::ReadFromDisk(const std::string& file, TGAHeader& pTGAfile)
 	fread(pTGAfile.imageDataBuffer, sizeof(unsigned char), imageSize, pFile);
 
 
-	for (int y = 0; y < pTGAfile.imageHeight; y++)
+	//Rows are independent so they are swizzled in parallel
+	TaskManager::Get().ParallelFor(0, pTGAfile.imageHeight, 0, [&pTGAfile, colorMode](size_t row)
 	{
-
+		int y = int(row);
 		for (int x = 0; x < pTGAfile.imageWidth; x++)
 		{
 			int index = y * pTGAfile.imageWidth + x;
@@ -142,7 +144,7 @@ void LoaderTGA::ReadFromDisk(const std::string& file, TGAHeader& pTGAfile)
 			pTGAfile.imageDataBuffer[index * colorMode + 2] = tempBlue;
 
 		}
-	}
+	});
 #if defined(TGADEBUG)
 	std::cout << "------------------------------------------" << std::endl;
 	std::cout << "file '" + file + "' header data:" << std::endl;
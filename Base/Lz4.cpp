@@ -0,0 +1,211 @@
+#include "Lz4.h"
+#include <cstring>
+#include <algorithm>
+
+//Limits from the block format: matches are at least 4 bytes, the last 5 bytes are always literals
+//and the last match has to start at least 12 bytes before the end
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_FIND_LIMIT 12
+
+static inline uint32_t Read32(const uint8_t* pData)
+{
+	uint32_t value;
+	memcpy(&value, pData, sizeof(value));
+	return value;
+}
+
+static inline uint32_t HashSequence(uint32_t sequence)
+{
+	return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+//Lengths that do not fit in the token nibble continue in bytes of 255 and end with a smaller byte
+static inline uint8_t* WriteLength(uint8_t* pOut, size_t length)
+{
+	for (; length >= 255; length -= 255)
+		*pOut++ = 255;
+
+	*pOut++ = uint8_t(length);
+	return pOut;
+}
+
+static inline bool ReadLength(const uint8_t*& pIn, const uint8_t* pInEnd, size_t& length)
+{
+	uint8_t value;
+	do
+	{
+		if (pIn >= pInEnd)
+			return false;
+
+		value = *pIn++;
+		length += value;
+	} while (value == 255);
+
+	return true;
+}
+
+size_t Lz4::GetCompressBound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+size_t Lz4::Compress(const void* pData, size_t size, void* pBuf, size_t bufSize)
+{
+	const uint8_t* pIn = reinterpret_cast<const uint8_t*>(pData);
+	uint8_t* pOut = reinterpret_cast<uint8_t*>(pBuf);
+	uint8_t* pOutEnd = pOut + bufSize;
+	size_t anchor = 0;
+
+	if (size > LZ4_MATCH_FIND_LIMIT)
+	{
+		//Positions are stored off by one so zero can mean empty
+		uint32_t table[1 << LZ4_HASH_BITS] = {};
+		size_t matchLimit = size - LZ4_LAST_LITERALS;
+		size_t position = 0;
+		size_t misses = 0;
+
+		while (position + LZ4_MATCH_FIND_LIMIT < size)
+		{
+			uint32_t sequence = Read32(pIn + position);
+			uint32_t& slot = table[HashSequence(sequence)];
+			size_t candidate = slot;
+			slot = uint32_t(position + 1);
+
+			if (candidate == 0 || position - (candidate - 1) > LZ4_MAX_OFFSET || Read32(pIn + candidate - 1) != sequence)
+			{
+				//Step faster through data that does not match so incompressible entries stay cheap
+				position += 1 + (misses++ >> 6);
+				continue;
+			}
+
+			size_t matchStart = candidate - 1;
+			size_t matchLength = LZ4_MIN_MATCH;
+			while (position + matchLength < matchLimit && pIn[matchStart + matchLength] == pIn[position + matchLength])
+				matchLength++;
+
+			size_t literalLength = position - anchor;
+			size_t requiredSize = 1 + literalLength / 255 + 1 + literalLength + 2 + matchLength / 255 + 1;
+			if (size_t(pOutEnd - pOut) < requiredSize)
+				return 0;
+
+			uint8_t* pToken = pOut++;
+			*pToken = uint8_t((literalLength < 15 ? literalLength : 15) << 4);
+			if (literalLength >= 15)
+				pOut = WriteLength(pOut, literalLength - 15);
+
+			memcpy(pOut, pIn + anchor, literalLength);
+			pOut += literalLength;
+
+			size_t offset = position - matchStart;
+			*pOut++ = uint8_t(offset);
+			*pOut++ = uint8_t(offset >> 8);
+
+			size_t storedLength = matchLength - LZ4_MIN_MATCH;
+			*pToken |= uint8_t(storedLength < 15 ? storedLength : 15);
+			if (storedLength >= 15)
+				pOut = WriteLength(pOut, storedLength - 15);
+
+			position += matchLength;
+			anchor = position;
+			misses = 0;
+		}
+	}
+
+	//The block always ends with a literal run, even an empty one
+	size_t literalLength = size - anchor;
+	if (size_t(pOutEnd - pOut) < 1 + literalLength / 255 + 1 + literalLength)
+		return 0;
+
+	*pOut++ = uint8_t((literalLength < 15 ? literalLength : 15) << 4);
+	if (literalLength >= 15)
+		pOut = WriteLength(pOut, literalLength - 15);
+
+	memcpy(pOut, pIn + anchor, literalLength);
+	pOut += literalLength;
+
+	return size_t(pOut - reinterpret_cast<uint8_t*>(pBuf));
+}
+
+bool Lz4::Decompress(const void* pCompressed, size_t compressedSize, void* pBuf, size_t uncompressedSize)
+{
+	return Decode(pCompressed, compressedSize, pBuf, uncompressedSize, false);
+}
+
+bool Lz4::DecompressPrefix(const void* pCompressed, size_t compressedSize, void* pBuf, size_t prefixSize)
+{
+	return Decode(pCompressed, compressedSize, pBuf, prefixSize, true);
+}
+
+bool Lz4::Decode(const void* pCompressed, size_t compressedSize, void* pBuf, size_t outputSize, bool isPrefix)
+{
+	const uint8_t* pIn = reinterpret_cast<const uint8_t*>(pCompressed);
+	const uint8_t* pInEnd = pIn + compressedSize;
+	uint8_t* pOutStart = reinterpret_cast<uint8_t*>(pBuf);
+	uint8_t* pOut = pOutStart;
+	uint8_t* pOutEnd = pOut + outputSize;
+
+	while (pIn < pInEnd)
+	{
+		uint8_t token = *pIn++;
+
+		size_t literalLength = token >> 4;
+		if (literalLength == 15 && !ReadLength(pIn, pInEnd, literalLength))
+			return false;
+
+		//A prefix stops as soon as the output is full
+		if (size_t(pOutEnd - pOut) < literalLength)
+		{
+			if (!isPrefix)
+				return false;
+
+			literalLength = size_t(pOutEnd - pOut);
+		}
+
+		if (size_t(pInEnd - pIn) < literalLength)
+			return false;
+
+		memcpy(pOut, pIn, literalLength);
+		pIn += literalLength;
+		pOut += literalLength;
+		if (isPrefix && pOut == pOutEnd)
+			return true;
+
+		//Only the last sequence has no match
+		if (pIn == pInEnd)
+			break;
+
+		if (pInEnd - pIn < 2)
+			return false;
+
+		size_t offset = size_t(pIn[0]) | (size_t(pIn[1]) << 8);
+		pIn += 2;
+		if (offset == 0 || offset > size_t(pOut - pOutStart))
+			return false;
+
+		size_t matchLength = token & 15;
+		if (matchLength == 15 && !ReadLength(pIn, pInEnd, matchLength))
+			return false;
+
+		matchLength += LZ4_MIN_MATCH;
+		if (size_t(pOutEnd - pOut) < matchLength)
+		{
+			if (!isPrefix)
+				return false;
+
+			matchLength = size_t(pOutEnd - pOut);
+		}
+
+		//Overlapping matches repeat the last offset bytes, every copy doubles the part that is known to repeat
+		const uint8_t* pMatch = pOut - offset;
+		while (matchLength > 0)
+		{
+			size_t copyLength = std::min(size_t(pOut - pMatch), matchLength);
+			memcpy(pOut, pMatch, copyLength);
+			pOut += copyLength;
+			matchLength -= copyLength;
+		}
+	}
+
+	return pOut == pOutEnd;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#define LZ4_HASH_BITS 12
+#define LZ4_MAX_OFFSET 65535
+
+//Compressor and decoder for the LZ4 block format, streams written here can be read by the reference
+//implementation and the other way around. The compressor is a plain greedy single probe matcher which
+//trades ratio for speed, the decoder checks every length against both buffers so corrupt data fails cleanly.
+class Lz4
+{
+public:
+	//Worst case output size for incompressible data
+	static size_t GetCompressBound(size_t size);
+	//Returns 0 if the output does not fit in bufSize
+	static size_t Compress(const void* pData, size_t size, void* pBuf, size_t bufSize);
+	//Fails unless the block decodes to exactly uncompressedSize bytes
+	static bool Decompress(const void* pCompressed, size_t compressedSize, void* pBuf, size_t uncompressedSize);
+	//Decodes only the first prefixSize bytes, the block may be cut off after the data they need
+	static bool DecompressPrefix(const void* pCompressed, size_t compressedSize, void* pBuf, size_t prefixSize);
+
+private:
+	static bool Decode(const void* pCompressed, size_t compressedSize, void* pBuf, size_t outputSize, bool isPrefix);
+};
@@ -5,6 +5,9 @@
 //include minimal windows headers
 #define WIN32_LEAN_AND_MEAN 1
 #include <windows.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
 #endif
 
 std::atomic_size_t MemoryManager::s_TotalAllocated = 0;
@@ -300,6 +303,13 @@ void* MemoryManager::Allocate(size_t allocationSizeInBytes, size_t alignment, co
 			}
 			else if (pNewFreeEntryAfter != nullptr)
 			{
+				//The only free block is also the previous one, the block after the allocation is then all that is left
+				if (pLastFree == pCurrentFree)
+				{
+					pLastFree = pNewFreeEntryAfter;
+					pCurrentFreeNext = pNewFreeEntryAfter;
+				}
+
 				pLastFree->pNext = pNewFreeEntryAfter;
 				pNewFreeEntryAfter->pNext = pCurrentFreeNext;
 
@@ -385,6 +395,10 @@ void MemoryManager::Free(void* allocationPtr)
 				{
 					size_t newFreeSize = pCurrentFree->sizeInBytes + allocation.sizeInBytes + pCurrentFree->pNext->sizeInBytes;
 
+					//With only two free blocks the one on the right is also the previous one, and it is merged away
+					if (pLastFree == pCurrentFree->pNext)
+						pLastFree = pCurrentFree;
+
 					FreeEntry* pCurrentFreeNextNext = pCurrentFree->pNext->pNext;
 					pNewFreeEntry = new(pCurrentFree) FreeEntry(newFreeSize);
 					pLastFree->pNext = pNewFreeEntry;
@@ -447,6 +461,14 @@ void MemoryManager::Free(void* allocationPtr)
 
 					FreeEntry* pCurrentFreeNext = pCurrentFree->pNext;
 					pNewFreeEntry = new((void*)offsetAllocationAddress) FreeEntry(newFreeSize);
+
+					//The only free block is also the previous one, and it is merged into the new one
+					if (pLastFree == pCurrentFree)
+					{
+						pLastFree = pNewFreeEntry;
+						pCurrentFreeNext = pNewFreeEntry;
+					}
+
 					pLastFree->pNext = pNewFreeEntry;
 					pNewFreeEntry->pNext = pCurrentFreeNext;
 
@@ -533,3 +555,27 @@ void MemoryManager::ClearStackAllocations()
 	m_StackAllocations.clear();
 }
 #endif
+
+void MemoryManager::BindToNumaNode(void* pMemory, size_t sizeInBytes, int32_t node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+	//Values from <numaif.h>, called directly so that we do not have to link against libnuma
+	constexpr int MPOL_PREFERRED_POLICY = 1;
+	constexpr unsigned MPOL_MF_MOVE_FLAG = (1 << 1);
+
+	if (node < 0 || node >= 64)
+		return;
+
+	//Only whole pages can be moved
+	size_t start = ((size_t)pMemory + MEMORY_PAGE_SIZE - 1) & ~(MEMORY_PAGE_SIZE - 1);
+	size_t end = ((size_t)pMemory + sizeInBytes) & ~(MEMORY_PAGE_SIZE - 1);
+	if (end <= start)
+		return;
+
+	unsigned long nodeMask = 1UL << node;
+	if (syscall(SYS_mbind, (void*)start, end - start, MPOL_PREFERRED_POLICY, &nodeMask, sizeof(nodeMask) * 8 + 1, MPOL_MF_MOVE_FLAG) != 0)
+	{
+		ThreadSafePrintf("MemoryManager: Failed to bind memory to NUMA node %d\n", node);
+	}
+#endif
+}
@@ -16,6 +16,7 @@
 #define SIZE_IN_BYTES 1024ULL * 1024ULL * 1024ULL // = 1024MB
 #define mm_allocate(...) MemoryManager::GetInstance().Allocate(__VA_ARGS__)
 #define mm_free(...) MemoryManager::GetInstance().Free(__VA_ARGS__)
+#define MEMORY_PAGE_SIZE 4096ULL
 
 struct Allocation
 {
@@ -145,9 +146,24 @@ public:
 	{
 		return s_TotalUsed;
 	}
+
+	//NUMA node that allocators on the calling thread should place their memory on, -1 means no preference
+	static void SetThreadNumaNode(int32_t node)
+	{
+		s_ThreadNumaNode = node;
+	}
+
+	static int32_t GetThreadNumaNode()
+	{
+		return s_ThreadNumaNode;
+	}
+
+	//Moves whole pages in the range to the node, does nothing for a negative node or on platforms without support
+	static void BindToNumaNode(void* pMemory, size_t sizeInBytes, int32_t node);
 private:
 	static std::atomic_size_t s_TotalAllocated;
 	static std::atomic_size_t s_TotalUsed;
+	inline static thread_local int32_t s_ThreadNumaNode = -1;
 };
 
 #endif
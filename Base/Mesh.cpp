@@ -1,5 +1,6 @@
 #include "Mesh.h"
 #include "MemoryManager.h"
+#include <algorithm>
 
 Mesh::Mesh(const Vertex* const vertices, const uint32_t* const indices, uint32_t numVertices, uint32_t numIndices)
 	: m_VAO(0),
@@ -7,8 +8,10 @@ Mesh::Mesh(const Vertex* const vertices, const uint32_t* const indices, uint32_t
 	m_IBO(0),
 	m_VertexCount(0),
 	m_IndexCount(0),
+	m_UploadedBytes(0),
 	m_pVertices(nullptr),
-	m_pIndices(nullptr)
+	m_pIndices(nullptr),
+	m_pStorage(nullptr)
 {
 	m_VertexCount	= numVertices;
 	m_IndexCount	= numIndices;
@@ -16,19 +19,17 @@ Mesh::Mesh(const Vertex* const vertices, const uint32_t* const indices, uint32_t
 	m_pIndices		= indices;
 }
 
-Mesh::~Mesh()
+Mesh::Mesh(void* pStorage, uint32_t numVertices, uint32_t numIndices)
+	: Mesh((const Vertex*)((uint8_t*)pStorage + sizeof(BinaryMeshData)),
+		(const uint32_t*)((uint8_t*)pStorage + sizeof(BinaryMeshData) + sizeof(Vertex) * numVertices),
+		numVertices, numIndices)
 {
-	if (m_pVertices)
-	{
-		mm_free((void*)m_pVertices);
-		m_pVertices = nullptr;
-	}
+	m_pStorage = pStorage;
+}
 
-	if (m_pIndices)
-	{
-		mm_free((void*)m_pIndices);
-		m_pIndices = nullptr;
-	}
+Mesh::~Mesh()
+{
+	FreeData();
 
 	if (glIsBuffer(m_VBO))
 	{
@@ -45,23 +46,84 @@ Mesh::~Mesh()
 
 void Mesh::Init()
 {
-	GL_CALL(glGenBuffers(1, &m_VBO));
-	GL_CALL(glGenBuffers(1, &m_IBO));
+	size_t bytesUploaded = 0;
+	while (!InitPartial(SIZE_MAX, bytesUploaded)) {}
+}
 
-	GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, m_VBO));
-	GL_CALL(glBufferData(GL_ARRAY_BUFFER, m_VertexCount * sizeof(Vertex), m_pVertices, GL_STATIC_DRAW));
+bool Mesh::InitPartial(size_t maxBytes, size_t& bytesUploaded)
+{
+	const size_t vertexBytes = m_VertexCount * sizeof(Vertex);
+	const size_t indexBytes = m_IndexCount * sizeof(uint32_t);
+	
+	//Allocate the buffers on the first call and fill them in chunks
+	if (m_VBO == 0)
+	{
+		GL_CALL(glGenBuffers(1, &m_VBO));
+		GL_CALL(glGenBuffers(1, &m_IBO));
 
-	GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IBO));
-	GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_IndexCount * sizeof(uint32_t), m_pIndices, GL_STATIC_DRAW));
+		GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, m_VBO));
+		GL_CALL(glBufferData(GL_ARRAY_BUFFER, vertexBytes, nullptr, GL_STATIC_DRAW));
+
+		GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IBO));
+		GL_CALL(glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, nullptr, GL_STATIC_DRAW));
+	}
+
+	size_t chunkSize = std::max<size_t>(maxBytes, MESH_MIN_UPLOAD_CHUNK);
+	bytesUploaded = 0;
+	
+	if (m_UploadedBytes < vertexBytes)
+	{
+		size_t numBytes = std::min(chunkSize, vertexBytes - m_UploadedBytes);
+		GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, m_VBO));
+		GL_CALL(glBufferSubData(GL_ARRAY_BUFFER, m_UploadedBytes, numBytes, (const char*)m_pVertices + m_UploadedBytes));
+
+		m_UploadedBytes += numBytes;
+		bytesUploaded += numBytes;
+		chunkSize -= numBytes;
+	}
+
+	if (chunkSize > 0 && m_UploadedBytes >= vertexBytes && m_UploadedBytes < vertexBytes + indexBytes)
+	{
+		size_t offset = m_UploadedBytes - vertexBytes;
+		size_t numBytes = std::min(chunkSize, indexBytes - offset);
+		GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IBO));
+		GL_CALL(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, numBytes, (const char*)m_pIndices + offset));
+
+		m_UploadedBytes += numBytes;
+		bytesUploaded += numBytes;
+	}
 
 	GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
 	GL_CALL(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
 
-	mm_free((void*)m_pVertices);
-	m_pVertices = nullptr;
+	if (m_UploadedBytes < vertexBytes + indexBytes)
+		return false;
+
+	FreeData();
+	return true;
+}
 
-	mm_free((void*)m_pIndices);
-	m_pIndices = nullptr;
+bool Mesh::TakePayload(IResource* pSource)
+{
+	Mesh* pMesh = dynamic_cast<Mesh*>(pSource);
+	if (!pMesh)
+		return false;
+
+	//The old buffers go with the source, which has never been initialized and frees the data we hand over
+	std::swap(m_pVertices, pMesh->m_pVertices);
+	std::swap(m_pIndices, pMesh->m_pIndices);
+	std::swap(m_pStorage, pMesh->m_pStorage);
+	std::swap(m_VBO, pMesh->m_VBO);
+	std::swap(m_IBO, pMesh->m_IBO);
+	m_VertexCount = pMesh->m_VertexCount;
+	m_IndexCount = pMesh->m_IndexCount;
+	m_UploadedBytes = 0;
+	return true;
+}
+
+size_t Mesh::GetPayloadSize() const
+{
+	return sizeof(BinaryMeshData) + m_VertexCount * sizeof(Vertex) + m_IndexCount * sizeof(uint32_t);
 }
 
 void Mesh::Release()
@@ -277,3 +339,56 @@ Mesh* Mesh::CreateQuad()
 
 	return new("Quad Mesh") Mesh(quadVertices, quadIndices, 4, 6);
 }
+
+void* Mesh::CreateStorage(const void* pHeader, size_t size)
+{
+	BinaryMeshData data = {};
+	memcpy(&data, pHeader, sizeof(BinaryMeshData));
+
+	//The storage holds the whole packaged mesh, so the counts have to match the entry exactly
+	size_t requiredSize = sizeof(BinaryMeshData) + sizeof(Vertex) * size_t(data.VertexCount) + sizeof(uint32_t) * size_t(data.IndexCount);
+	if (requiredSize != size)
+		return nullptr;
+
+	return mm_allocate(size, alignof(Vertex), "Mesh Storage");
+}
+
+Mesh* Mesh::CreateFromStorage(void* pStorage, size_t size)
+{
+	if (size < sizeof(BinaryMeshData))
+		return nullptr;
+
+	BinaryMeshData data = {};
+	memcpy(&data, pStorage, sizeof(BinaryMeshData));
+
+	//The data read into the storage may not be what CreateStorage sized it for, the counts are checked again
+	size_t requiredSize = sizeof(BinaryMeshData) + sizeof(Vertex) * size_t(data.VertexCount) + sizeof(uint32_t) * size_t(data.IndexCount);
+	if (requiredSize != size)
+		return nullptr;
+
+	return new("Mesh LoadedFromStorage") Mesh(pStorage, data.VertexCount, data.IndexCount);
+}
+
+void Mesh::FreeData()
+{
+	if (m_pStorage)
+	{
+		mm_free((void*)m_pStorage);
+		m_pStorage = nullptr;
+		m_pVertices = nullptr;
+		m_pIndices = nullptr;
+		return;
+	}
+
+	if (m_pVertices)
+	{
+		mm_free((void*)m_pVertices);
+		m_pVertices = nullptr;
+	}
+
+	if (m_pIndices)
+	{
+		mm_free((void*)m_pIndices);
+		m_pIndices = nullptr;
+	}
+}
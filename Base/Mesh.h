@@ -8,6 +8,8 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
 
+#define MESH_MIN_UPLOAD_CHUNK 64 * 1024
+
 //Define vertex used by application
 struct Vertex
 {
@@ -68,10 +70,16 @@ public:
 	Mesh& operator=(const Mesh& other) = delete;
 
 	Mesh(const Vertex* const vertices, const uint32_t* const indices, uint32_t numVertices, uint32_t numIndices);
+	//The vertices and indices point into the storage, which holds a packaged mesh and is freed as one allocation
+	Mesh(void* pStorage, uint32_t numVertices, uint32_t numIndices);
 	~Mesh();
 
 	virtual void Init() override;
 	virtual void Release() override;
+	//Uploads the vertices and then the indices in chunks with glBufferSubData
+	virtual bool InitPartial(size_t maxBytes, size_t& bytesUploaded) override;
+	virtual bool TakePayload(IResource* pSource) override;
+	virtual size_t GetPayloadSize() const override;
 
 	void Draw(const sf::Shader& shader);
 
@@ -90,11 +98,21 @@ private:
 	GLuint m_IBO;
 	uint32_t m_VertexCount;
 	uint32_t m_IndexCount;
+	size_t m_UploadedBytes;
 	const Vertex* m_pVertices;
 	const uint32_t* m_pIndices;
+	void* m_pStorage;
+
+	void FreeData();
 public:
 	static Mesh* CreateCube();
 	static Mesh* CreateCubeInvNormals();
 	static Mesh* CreateQuad();
+
+	//Allocates storage for a packaged mesh of size bytes after checking it against the header, nullptr if they do not match
+	static void* CreateStorage(const void* pHeader, size_t size);
+	//Takes ownership of storage that holds a whole packaged mesh. Returns nullptr without taking it if the counts in the
+	//header do not match size
+	static Mesh* CreateFromStorage(void* pStorage, size_t size);
 };
 
@@ -128,7 +128,11 @@ public:
 
 		inline bool AllocateChunkAndSetHead()
 		{
-			Chunk* pChunk = new(mm_allocate(sizeof(Chunk), sizeof(Chunk), "Pool Allocation Chunk")) Chunk();
+			//Place the chunk on the same NUMA node as the thread that owns the arena before it gets touched
+			void* pMemory = mm_allocate(sizeof(Chunk), sizeof(Chunk), "Pool Allocation Chunk");
+			MemoryManager::BindToNumaNode(pMemory, sizeof(Chunk), MemoryManager::GetThreadNumaNode());
+
+			Chunk* pChunk = new(pMemory) Chunk();
 			pChunk->m_pArena = this;
 
 			m_Chunks.emplace_back(pChunk);
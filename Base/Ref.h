@@ -12,6 +12,10 @@ public:
 			m_RefCountable->AddRef();
 	};
 
+	inline RefBase(const RefBase& other) : RefBase(other.m_RefCountable)
+	{
+	};
+
 	virtual inline ~RefBase()
 	{
 		if (m_RefCountable)
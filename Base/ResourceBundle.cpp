@@ -3,13 +3,19 @@
 
 ResourceBundle::ResourceBundle(size_t* guids, size_t nrOfGuids) :
 	m_Guids(guids),
-	m_NrOfGuids(nrOfGuids)
+	m_NrOfGuids(nrOfGuids),
+	m_IsHoldingReferences(true)
 {
-
+	//The bundle keeps its resources from being evicted while it is alive
+	ResourceManager& resourceManager = ResourceManager::Get();
+	for (size_t i = 0; i < m_NrOfGuids; i++)
+		resourceManager.GetStrongResource(m_Guids[i]);
 }
 
 ResourceBundle::~ResourceBundle()
 {
+	ReleaseReferences();
+
 	if (m_Guids)
 	{
 		mm_free(m_Guids);
@@ -38,9 +44,28 @@ Ref<Mesh> ResourceBundle::GetMesh(const std::string& file)
 
 void ResourceBundle::Unload()
 {
+	ReleaseReferences();
+
+	//Dependents are stored after their dependencies, unloading them first drops their references to the dependencies
+	ResourceManager& resourceManager = ResourceManager::Get();
+	for (size_t i = m_NrOfGuids; i > 0; i--)
+	{
+		resourceManager.UnloadResource(m_Guids[i - 1]);
+	}
+}
+
+void ResourceBundle::ReleaseReferences()
+{
+	if (!m_IsHoldingReferences)
+		return;
+
 	ResourceManager& resourceManager = ResourceManager::Get();
-	for (int i = 0; i < m_NrOfGuids; i++)
+	for (size_t i = 0; i < m_NrOfGuids; i++)
 	{
-		resourceManager.UnloadResource(m_Guids[i]);
+		IResource* resource = resourceManager.GetResource(m_Guids[i]);
+		if (resource)
+			resource->RemoveRef();
 	}
+
+	m_IsHoldingReferences = false;
 }
\ No newline at end of file
@@ -19,6 +19,7 @@ public:
 	Ref<Mesh> GetMesh(size_t guid);
 	Ref<Mesh> GetMesh(const std::string& file);
 
+	//Releases the bundle's references and unloads the resources that nothing else holds
 	void Unload();
 
 	inline void* operator new(size_t size, const char* tag)
@@ -34,7 +35,11 @@ public:
 	{
 		PoolAllocator<ResourceBundle>::Get().FreeBlock(ptr);
 	}
+private:
+	void ReleaseReferences();
+
 private:
 	size_t* m_Guids;
 	size_t m_NrOfGuids;
+	bool m_IsHoldingReferences;
 };
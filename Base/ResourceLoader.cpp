@@ -92,6 +92,13 @@ size_t ResourceLoader::WriteResourceToBuffer(const std::string& file, void* buff
 	return loader->WriteToBuffer(file, buffer);
 }
 
+void ResourceLoader::GetResourceDependencies(const std::string& file, std::vector<std::string>& dependencies)
+{
+	ILoader* loader = GetLoader(HashString(GetFileType(file).c_str()));
+	if (loader)
+		loader->GetDependencies(file, dependencies);
+}
+
 ILoader* ResourceLoader::GetLoader(size_t hash)
 {
 	std::unordered_map<size_t, ILoader*>::const_iterator iterator = m_LoaderMap.find(hash);
@@ -26,6 +26,7 @@ private:
 
 	IResource* LoadResourceFromMemory(void* data, size_t size, size_t typeHash, const std::string& file);
 	size_t WriteResourceToBuffer(const std::string& file, void* buffer);
+	void GetResourceDependencies(const std::string& file, std::vector<std::string>& dependencies);
 	ILoader* GetLoader(size_t hash);
 	std::string GetFileType(const std::string& file);
 
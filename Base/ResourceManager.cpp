@@ -3,127 +3,252 @@
 #include "ResourceLoader.h"
 #include "TaskManager.h"
 #include "ResourceBundle.h"
+#include "EvictionPolicies.h"
+#include "TaskProfiler.h"
+#include "Camera.h"
 #include <mutex>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <filesystem>
+#include <unordered_set>
+
+#ifdef __linux__
+	#include <sys/inotify.h>
+	#include <poll.h>
+	#include <unistd.h>
+#endif
 
 ResourceManager::ResourceManager()
-	: m_IsCleanup(false),
+	: m_LoadedAliases(0),
+	m_IsCleanup(false),
 	m_MaxMemory(RESOURCE_MANAGER_MAX_MEMORY),
-	m_UsedMemory(0)
+	m_UsedMemory(0),
+	m_pMostRecent(nullptr),
+	m_pLeastRecent(nullptr),
+	m_AccessTick(0),
+	m_pEvictionPolicy(new LRUEvictionPolicy()),
+	m_CacheHits(0),
+	m_CacheMisses(0),
+	m_Evictions(0),
+	m_EvictedBytes(0),
+	m_FinalizeQueue(),
+	m_LockFinalize(),
+	m_FinalizeStats(),
+	m_PeakFinalizeMilliseconds(0.0f),
+	m_StreamingRequests(),
+	m_StreamingQueue(),
+	m_StreamingFrame(0),
+	m_StreamingStats(),
+	m_TotalTimeToVisible(0.0f),
+	m_HotReloadThread(),
+	m_IsHotReloading(false),
+	m_IsRecordingAccess(false)
 {
 
 }
 
 ResourceManager::~ResourceManager()
 {
+	DisableHotReload();
+	CancelStreaming();
 	ResourceManager::UnloadUnusedResources(true);
+	delete m_pEvictionPolicy;
 }
 
-bool ResourceManager::LoadResource(ResourceLoader& resourceLoader, Archiver& archiver, size_t guid, const std::string& file)
+void* ResourceManager::PrepareLoad(ResourceLoader& resourceLoader, Archiver& archiver, size_t guid, const std::string& file, size_t& size, size_t& typeHash, LoadBuffer& buffer)
 {
-	size_t size = archiver.ReadRequiredSizeForPackageData(guid);
+	size = archiver.ReadRequiredSizeForPackageData(guid);
 	if (size == 0)
 	{
 		ThreadSafePrintf("Failed to read size of [%s]!\n", file.c_str());
-		return false;
+		return nullptr;
 	}
 
 	if (m_UsedMemory + size > m_MaxMemory)
 	{
-		ThreadSafePrintf("No more memory available, will try to release unused resources!\n");
-		UnloadUnusedResources();
+		ThreadSafePrintf("No more memory available, will try to evict unused resources!\n");
+		EvictResources(m_UsedMemory + size - m_MaxMemory);
 		if (m_UsedMemory + size > m_MaxMemory)
 		{
 			ThreadSafePrintf("Error! No more memory available for [%s]!\n", file.c_str());
-			return false;
+			return nullptr;
 		}
 	}
 
 	m_UsedMemory += size;
 
-	void* data = mm_allocate(size, 1, "LoadResource Buffer");
-	size_t typeHash;
-	if (!archiver.ReadPackageData(guid, typeHash, data, size))
+	//Entries stored uncompressed in a mapped package are parsed straight from the mapping
+	const void* pView = nullptr;
+	if (archiver.GetPackageDataView(guid, typeHash, pView, size))
 	{
-		ThreadSafePrintf("Failed to load resource data [%s]!\n", file.c_str());
-		mm_free(data);
-		return false;
+		buffer = BUFFER_VIEW;
+		return (void*)pView;
+	}
+
+	//Loaders that keep the entry as their own memory get it decompressed straight into that memory,
+	//the header they need to size it is decompressed on its own first
+	ILoader* loader = resourceLoader.GetLoader(archiver.GetPackageEntryType(guid));
+	size_t headerSize = loader ? loader->GetStorageHeaderSize() : 0;
+	if (headerSize > 0 && headerSize <= size)
+	{
+		void* pStorage = nullptr;
+		void* pHeader = mm_allocate(headerSize, 8, "LoadResource Header");
+		if (archiver.ReadPackageDataPrefix(guid, typeHash, pHeader, headerSize))
+			pStorage = loader->CreateStorage(pHeader, size);
+
+		mm_free(pHeader);
+		if (pStorage)
+		{
+			buffer = BUFFER_STORAGE;
+			return pStorage;
+		}
+	}
+
+	buffer = BUFFER_TEMPORARY;
+	return mm_allocate(size, 1, "LoadResource Buffer");
+}
+
+IResource* ResourceManager::FinishLoad(ResourceLoader& resourceLoader, size_t guid, const std::string& file, void* data, size_t size, size_t typeHash, LoadBuffer buffer)
+{
+	IResource* resource = nullptr;
+	if (buffer == BUFFER_STORAGE)
+	{
+		//The loader takes the storage over, a loader that fails to has not freed it
+		ILoader* loader = resourceLoader.GetLoader(typeHash);
+		resource = loader ? loader->LoadFromStorage(data, size) : nullptr;
+		if (!resource)
+			mm_free(data);
+	}
+	else
+	{
+		resource = resourceLoader.LoadResourceFromMemory(data, size, typeHash, file);
+		if (buffer == BUFFER_TEMPORARY)
+			mm_free(data);
 	}
 
-	IResource* resource = resourceLoader.LoadResourceFromMemory(data, size, typeHash, file);
 	if (!resource)
 	{
 		ThreadSafePrintf("Failed to create resource [%s]!\n", file.c_str());
-		mm_free(data);
-		return false;
+		m_UsedMemory -= size;
+		return nullptr;
 	}
 
 	resource->m_Guid = guid;
 	resource->m_Size = size;
 	resource->m_Name = file;
-	mm_free(data);
+	Archiver::GetInstance().GetPackageEntryDependencies(guid, resource->m_Dependencies);
+	Archiver::GetInstance().GetPackageEntryAliases(guid, resource->m_Aliases);
 
+	//Referenced before it becomes visible, otherwise another load making room could evict it before the requesters have it
 	{
 		std::scoped_lock<SpinLock> lock(m_LockLoaded);
-		m_LoadedResources.insert({ guid, resource });
+		resource->AddRef();
+		InsertLoadedResource(resource);
+		TouchResource(resource);
+		AddDependencyRefs(resource);
 	}
 
+	//GPU resources has to be created on the main thread
 	{
-		std::scoped_lock<SpinLock> lock(m_LockInitiate);
-		m_ResourcesToInitiate.push_back(guid);
+		std::scoped_lock<SpinLock> lock(m_LockFinalize);
+		m_FinalizeQueue.push_back(guid);
 	}
-	return true;
+	return resource;
+}
+
+void ResourceManager::StartLevel(ResourceLoader& resourceLoader, Archiver& archiver, const std::vector<ResolvedResource>& level, std::vector<std::shared_ptr<LoadRequest>>& requests, std::vector<IResource*>& pins, std::vector<BatchedLoad>& loads, std::vector<Archiver::PackageRead>& reads)
+{
+	for (size_t i = 0; i < level.size(); i++)
+	{
+		bool isOwner = false;
+		IResource* pLoaded = nullptr;
+		requests[i] = AcquireLoad(level[i].guid, isOwner, pLoaded);
+		if (pLoaded)
+			pins.push_back(pLoaded);
+
+		if (!isOwner)
+			continue;
+
+		BatchedLoad load = { i, 0, nullptr, 0, 0, BUFFER_TEMPORARY };
+		load.data = PrepareLoad(resourceLoader, archiver, level[i].guid, level[i].file, load.size, load.typeHash, load.buffer);
+		if (!load.data)
+		{
+			CompleteLoad(level[i].guid, requests[i], nullptr);
+			continue;
+		}
+
+		if (load.buffer != BUFFER_VIEW)
+		{
+			load.readIndex = reads.size();
+			reads.push_back({ level[i].guid, load.data, load.size, 0, false });
+		}
+
+		loads.push_back(load);
+	}
+}
+
+void ResourceManager::FinishLevel(ResourceLoader& resourceLoader, const std::vector<ResolvedResource>& level, const std::vector<std::shared_ptr<LoadRequest>>& requests, std::vector<BatchedLoad>& loads, const std::vector<Archiver::PackageRead>& reads)
+{
+	TaskManager::Get().ParallelFor(0, loads.size(), 1, [&](size_t i)
+	{
+		BatchedLoad& load = loads[i];
+		const ResolvedResource& resource = level[load.resolvedIndex];
+
+		IResource* pLoaded = nullptr;
+		if (load.buffer != BUFFER_VIEW && !reads[load.readIndex].isRead)
+		{
+			ThreadSafePrintf("Failed to load resource data [%s]!\n", resource.file.c_str());
+			mm_free(load.data);
+			m_UsedMemory -= load.size;
+		}
+		else
+		{
+			size_t typeHash = load.buffer == BUFFER_VIEW ? load.typeHash : reads[load.readIndex].typeHash;
+			pLoaded = FinishLoad(resourceLoader, resource.guid, resource.file, load.data, load.size, typeHash, load.buffer);
+		}
+
+		CompleteLoad(resource.guid, requests[load.resolvedIndex], pLoaded);
+	});
 }
 
 IResource* ResourceManager::GetResource(size_t guid)
 {
-	std::scoped_lock<SpinLock> lock(m_LockLoaded);
-	std::unordered_map<size_t, IResource*>::const_iterator iterator = m_LoadedResources.find(guid);
-	if (iterator == m_LoadedResources.end())
+	IResource* resource = m_LoadedResources.Find(guid);
+	if (!resource)
 	{
 		//ThreadSafePrintf("Resource not found! [%lu]\n", guid);
 		return nullptr;
 	}
 
-	return iterator->second;
+	TryTouchResource(resource);
+	return resource;
 }
 
 IResource* ResourceManager::GetResource(const std::string& file)
 {
-	std::scoped_lock<SpinLock> lock(m_LockLoaded);
-	std::unordered_map<size_t, IResource*>::const_iterator iterator = m_LoadedResources.find(HashString(file.c_str()));
-	if (iterator == m_LoadedResources.end())
-	{
-		//ThreadSafePrintf("Resource not found! [%s]\n", file.c_str());
-		return nullptr;
-	}
-	return iterator->second;
-}
-
-IResource* ResourceManager::GetStrongResource(const std::string& file)
-{
-	std::scoped_lock<SpinLock> lock(m_LockLoaded);
-	std::unordered_map<size_t, IResource*>::const_iterator iterator = m_LoadedResources.find(HashString(file.c_str()));
-	if (iterator == m_LoadedResources.end())
-	{
-		//ThreadSafePrintf("Resource not found! [%s]\n", file.c_str());
-		return nullptr;
-	}
-	iterator->second->AddRef();
-	return iterator->second;
+	return GetResource(HashString(file.c_str()));
+}
+
+IResource* ResourceManager::GetStrongResource(const std::string& file)
+{
+	return GetStrongResource(HashString(file.c_str()));
 }
 
-IResource* ResourceManager::GetStrongResource(size_t guid)
-{
+IResource* ResourceManager::GetStrongResource(size_t guid)
+{
+	//Taking a reference has to be serialized with eviction, so this lookup still holds the lock
 	std::scoped_lock<SpinLock> lock(m_LockLoaded);
-	std::unordered_map<size_t, IResource*>::const_iterator iterator = m_LoadedResources.find(guid);
-	if (iterator == m_LoadedResources.end())
+	IResource* resource = m_LoadedResources.Find(guid);
+	if (!resource)
 	{
 		//ThreadSafePrintf("Resource not found! [%lu]\n", guid);
 		return nullptr;
 	}
 
-	iterator->second->AddRef();
-	return iterator->second;
+	TouchResource(resource);
+	resource->AddRef();
+	return resource;
 }
 
 Ref<ResourceBundle> ResourceManager::LoadResources(std::vector<std::string> files)
@@ -131,89 +256,251 @@ Ref<ResourceBundle> ResourceManager::LoadResources(std::vector<std::string> file
 	Archiver& archiver = Archiver::GetInstance();
 	ResourceLoader& resourceLoader = ResourceLoader::Get();
 
-	archiver.OpenCompressedPackage(PACKAGE_PATH, Archiver::LOAD_AND_PREPARE);
+	archiver.OpenCompressedPackage(PACKAGE_PATH, PACKAGE_MODE);
+
+	std::vector<std::vector<ResolvedResource>> levels;
+	if (!ResolveDependencies(archiver, files, levels))
+		return Ref<ResourceBundle>();
 
-	size_t* guidArray = new(mm_allocate(files.size()*sizeof(size_t), 1, "GUID Array")) size_t[files.size()];
-	int index = 0;
-	for (std::string& file : files)
+	//Resources in a level only depend on earlier levels, so every level is loaded in parallel. Every resource is pinned
+	//from the moment it is loaded until the bundle holds it, otherwise making room for other loads could evict it
+	std::vector<IResource*> pins;
+	for (std::vector<ResolvedResource>& level : levels)
 	{
-		size_t guid = HashString(file.c_str());
-		std::unordered_map<size_t, IResource*>::const_iterator iterator = m_LoadedResources.find(guid);
-		if (iterator == m_LoadedResources.end())
+		std::vector<std::shared_ptr<LoadRequest>> requests(level.size());
+		std::vector<BatchedLoad> loads;
+		std::vector<Archiver::PackageRead> reads;
+		StartLevel(resourceLoader, archiver, level, requests, pins, loads, reads);
+
+		//Submitting the whole level at once lets the archiver keep the disk busy while earlier entries inflate
+		archiver.ReadPackageDataBatch(reads.data(), reads.size());
+		FinishLevel(resourceLoader, level, requests, loads, reads);
+
+		//Help out with queued tasks while other threads finish the loads we attached to
+		for (std::shared_ptr<LoadRequest>& request : requests)
 		{
-			if (!LoadResource(resourceLoader, archiver, guid, file))
-			{
-				mm_free((void*)guidArray);
-				return Ref<ResourceBundle>();
-			}
-			//ThreadSafePrintf("Loaded [%s]\n", file.c_str());
+			if (request)
+				TaskManager::Get().WaitForCounter(request->pending);
+		}
+
+		if (!PinRequests(requests, pins))
+		{
+			ReleasePins(pins);
+			return Ref<ResourceBundle>();
 		}
-			
-		guidArray[index++] = guid;
 	}
 
-	return Ref<ResourceBundle>(new("ResourceBundle") ResourceBundle(guidArray, files.size()));
+	Ref<ResourceBundle> bundle = CreateBundle(levels);
+	ReleasePins(pins);
+	return bundle;
 }
 
-void ResourceManager::LoadResourcesInBackground(std::vector<std::string> files, const std::function<void(const Ref<ResourceBundle>&)>& callback)
+AsyncTask<Ref<ResourceBundle>> ResourceManager::LoadAsync(std::vector<std::string> files)
 {
-	TaskManager& taskManager = TaskManager::Get();
-	taskManager.Execute(std::bind(&ResourceManager::BackgroundLoading, this, std::move(files), callback));
-}
+	co_await TaskManager::Get().Schedule(TaskManager::PRIORITY_BACKGROUND, "LoadAsync");
 
-void ResourceManager::BackgroundLoading(std::vector<std::string> files, const std::function<void(const Ref<ResourceBundle>&)>& callback)
-{
 	Archiver& archiver = Archiver::GetInstance();
 	ResourceLoader& resourceLoader = ResourceLoader::Get();
-	std::vector<std::pair<size_t, std::string>> resourcesToLoad;
-	size_t* guidArray = new(mm_allocate(files.size() * sizeof(size_t), 1, "GUID Array")) size_t[files.size()];
-	int index = 0;
 
-	archiver.OpenCompressedPackage(PACKAGE_PATH, Archiver::LOAD_AND_PREPARE);
+	archiver.OpenCompressedPackage(PACKAGE_PATH, PACKAGE_MODE);
 
-	//Find resources to load
-	for (std::string file : files)
+	std::vector<std::vector<ResolvedResource>> levels;
+	if (!ResolveDependencies(archiver, files, levels))
+		co_return Ref<ResourceBundle>();
+
+	std::vector<IResource*> pins;
+	for (std::vector<ResolvedResource>& level : levels)
 	{
-		size_t guid = HashString(file.c_str());
-		if (!IsResourceLoaded(guid))
+		//Start every load in the level, resources that are already being loaded are shared with the other requester
+		std::vector<std::shared_ptr<LoadRequest>> requests(level.size());
+		std::vector<BatchedLoad> loads;
+		std::vector<Archiver::PackageRead> reads;
+		StartLevel(resourceLoader, archiver, level, requests, pins, loads, reads);
+
+		//The I/O thread reads the whole level while this worker is given back to the queue
+		co_await archiver.ReadPackageDataBatchAsync(reads.data(), reads.size());
+		FinishLevel(resourceLoader, level, requests, loads, reads);
+
+		//Suspend until the loads owned by other requesters are finished as well. The awaiter is named, GCC 12 destroys a braced awaiter temporary twice
+		//and would drop a reference to the request that it never took
+		for (std::shared_ptr<LoadRequest>& request : requests)
 		{
-			std::scoped_lock<SpinLock> lock(m_LockLoading);
-			if (!IsResourceBeingLoadedInternal(guid))
-			{
-				m_ResourcesToBeLoaded.push_back(guid);
-				resourcesToLoad.push_back({ guid, file });
-			}
+			if (!request)
+				continue;
+
+			LoadRequestAwaiter awaiter{ request };
+			co_await awaiter;
 		}
-		guidArray[index++] = guid;
+
+		if (!PinRequests(requests, pins))
+		{
+			ReleasePins(pins);
+			co_return Ref<ResourceBundle>();
+		}
+	}
+
+	Ref<ResourceBundle> bundle = CreateBundle(levels);
+	ReleasePins(pins);
+	co_return bundle;
+}
+
+bool ResourceManager::ResolveDependencies(Archiver& archiver, const std::vector<std::string>& files, std::vector<std::vector<ResolvedResource>>& levels)
+{
+	std::unordered_map<size_t, int32_t> depths;
+	for (const std::string& file : files)
+	{
+		int32_t depth = 0;
+		if (!ResolveDependency(archiver, HashString(file.c_str()), file, depths, levels, depth))
+			return false;
 	}
 
-	//Load resources
-	for (auto& pair1 : resourcesToLoad)
+	return true;
+}
+
+bool ResourceManager::ResolveDependency(Archiver& archiver, size_t guid, const std::string& file, std::unordered_map<size_t, int32_t>& depths, std::vector<std::vector<ResolvedResource>>& levels, int32_t& depth)
+{
+	auto iterator = depths.find(guid);
+	if (iterator != depths.end())
 	{
-		if (!LoadResource(resourceLoader, archiver, pair1.first, pair1.second))
+		if (iterator->second == DEPENDENCY_VISITING)
 		{
-			mm_free((void*)guidArray);
-			callback(Ref<ResourceBundle>());
-			std::scoped_lock<SpinLock> lock(m_LockLoading);
-			for (auto& pair2 : resourcesToLoad)
-			{
-				m_ResourcesToBeLoaded.erase(std::find(m_ResourcesToBeLoaded.begin(), m_ResourcesToBeLoaded.end(), pair2.first));
-			}
-			return;
+			ThreadSafePrintf("Error! Circular dependency found at [%s]!\n", file.c_str());
+			return false;
 		}
-		//ThreadSafePrintf("Loaded [%s] in background!\n", pair1.second.c_str());
+
+		depth = iterator->second;
+		return true;
+	}
+
+	if (!archiver.HasPackageEntry(guid))
+	{
+		ThreadSafePrintf("Error! [%s] is not in the package!\n", file.c_str());
+		return false;
+	}
+
+	//Entries with the same content are loaded once under the first GUID, the others are registered as its aliases
+	size_t canonicalGuid = archiver.GetPackageEntryCanonical(guid);
+	if (canonicalGuid != guid)
+		return ResolveDependency(archiver, canonicalGuid, archiver.GetPackageEntryName(canonicalGuid), depths, levels, depth);
+
+	depths[guid] = DEPENDENCY_VISITING;
+
+	std::vector<size_t> dependencies;
+	archiver.GetPackageEntryDependencies(guid, dependencies);
+
+	int32_t dependencyDepth = -1;
+	for (size_t dependency : dependencies)
+	{
+		int32_t childDepth = 0;
+		if (!ResolveDependency(archiver, dependency, archiver.GetPackageEntryName(dependency), depths, levels, childDepth))
+			return false;
+
+		dependencyDepth = std::max(dependencyDepth, childDepth);
+	}
+
+	//Bundles only list other resources and are never loaded themselves
+	if (archiver.GetPackageEntryType(guid) == HashString(BUNDLE_FILE_EXTENSION))
+	{
+		depth = dependencyDepth;
+		depths[guid] = depth;
+		return true;
+	}
+
+	depth = dependencyDepth + 1;
+	depths[guid] = depth;
+	if (levels.size() <= size_t(depth))
+		levels.resize(depth + 1);
+
+	levels[depth].push_back({ guid, file });
+	return true;
+}
+
+Ref<ResourceBundle> ResourceManager::CreateBundle(const std::vector<std::vector<ResolvedResource>>& levels)
+{
+	size_t numResources = 0;
+	for (const std::vector<ResolvedResource>& level : levels)
+		numResources += level.size();
+
+	//Dependencies come before the resources that need them
+	size_t* guidArray = new(mm_allocate(std::max<size_t>(numResources, 1) * sizeof(size_t), 1, "GUID Array")) size_t[numResources];
+	size_t index = 0;
+	for (const std::vector<ResolvedResource>& level : levels)
+	{
+		for (const ResolvedResource& resource : level)
+			guidArray[index++] = resource.guid;
+	}
+
+	return Ref<ResourceBundle>(new("ResourceBundle") ResourceBundle(guidArray, numResources));
+}
+
+std::shared_ptr<ResourceManager::LoadRequest> ResourceManager::AcquireLoad(size_t guid, bool& isOwner, IResource*& pLoaded)
+{
+	std::scoped_lock<SpinLock> lock(m_LockLoading);
+
+	//A request is removed after the resource is inserted, so checking in this order never misses a finished load
+	auto iterator = m_InFlightLoads.find(guid);
+	if (iterator != m_InFlightLoads.end())
+	{
+		m_CacheHits++;
+		isOwner = false;
+		iterator->second->nrOfRequesters++;
+		return iterator->second;
+	}
+
+	pLoaded = GetStrongResource(guid);
+	if (pLoaded)
+	{
+		m_CacheHits++;
+		return nullptr;
+	}
+
+	m_CacheMisses++;
+	isOwner = true;
+	std::shared_ptr<LoadRequest> request = std::make_shared<LoadRequest>();
+	m_InFlightLoads.insert({ guid, request });
+	return request;
+}
+
+void ResourceManager::CompleteLoad(size_t guid, const std::shared_ptr<LoadRequest>& request, IResource* pResource)
+{
+	//Nobody can attach once the request is removed, so the count is final
+	uint32_t nrOfRequesters = 0;
+	{
 		std::scoped_lock<SpinLock> lock(m_LockLoading);
-		m_ResourcesToBeLoaded.erase(std::find(m_ResourcesToBeLoaded.begin(), m_ResourcesToBeLoaded.end(), pair1.first));
+		m_InFlightLoads.erase(guid);
+		nrOfRequesters = request->nrOfRequesters;
+	}
+
+	//The load's own reference goes to the first requester, the resource can not be evicted while it holds it
+	if (pResource)
+	{
+		for (uint32_t i = 1; i < nrOfRequesters; i++)
+			pResource->AddRef();
 	}
 
-	//Wait to make sure all resources are loaded, in case the resource is loaded from another thread
-	for (size_t i = 0; i < files.size(); i++)
+	std::vector<std::coroutine_handle<>> waiters;
 	{
-		size_t guid = guidArray[i];
-		while (!IsResourceLoaded(guid)){}
+		std::scoped_lock<SpinLock> lock(request->lock);
+		request->succeeded = pResource != nullptr;
+		request->pResource = pResource;
+		request->pending.store(0, std::memory_order_release);
+		waiters.swap(request->waiters);
 	}
 
-	callback(Ref<ResourceBundle>(new("ResourceBundle") ResourceBundle(guidArray, files.size())));
+	//Resume the waiters on workers so that this load is not held up by them
+	for (std::coroutine_handle<> waiter : waiters)
+		TaskManager::Get().Execute([waiter] { waiter.resume(); }, TaskManager::PRIORITY_BACKGROUND, "LoadAsync resume");
+}
+
+void ResourceManager::LoadResourcesInBackground(std::vector<std::string> files, const std::function<void(const Ref<ResourceBundle>&)>& callback)
+{
+	BackgroundLoading(std::move(files), callback);
+}
+
+DetachedTask ResourceManager::BackgroundLoading(std::vector<std::string> files, std::function<void(const Ref<ResourceBundle>&)> callback)
+{
+	Ref<ResourceBundle> bundle = co_await LoadAsync(std::move(files));
+	callback(bundle);
 }
 
 void ResourceManager::UnloadResource(IResource* resource)
@@ -221,14 +508,12 @@ void ResourceManager::UnloadResource(IResource* resource)
 	if (!m_IsCleanup)
 	{
 		std::scoped_lock<SpinLock> lock(m_LockLoaded);
-		for (auto it = m_LoadedResources.begin(); it != m_LoadedResources.end(); ++it)
+		if (m_LoadedResources.Find(resource->m_Guid) == resource)
 		{
-			if (it->second == resource)
-			{
-				m_LoadedResources.erase(it);
-				m_UsedMemory -= resource->m_Size;
-				break;
-			}
+			EraseLoadedResource(resource);
+			UnlinkResource(resource);
+			RemoveDependencyRefs(resource);
+			m_UsedMemory -= resource->m_Size;
 		}
 	}
 }
@@ -237,55 +522,183 @@ void ResourceManager::UnloadUnusedResources(bool force)
 {
 	std::scoped_lock<SpinLock> lock(m_LockLoaded);
 	std::vector<IResource*> resourcesToUnload;
+	m_LoadedResources.ForEach([&](size_t guid, IResource* resource)
+	{
+		if (guid != resource->m_Guid)
+			return;
+
+		if (resource->GetRefCount() == 0 || force)
+			resourcesToUnload.push_back(resource);
+	});
+
+	ReleaseResources(resourcesToUnload);
+}
+
+bool ResourceManager::EvictResources(size_t bytesToFree)
+{
+	std::scoped_lock<SpinLock> lock(m_LockLoaded);
+	std::vector<IResource*> victims;
+	m_pEvictionPolicy->SelectVictims(m_pLeastRecent, m_AccessTick, bytesToFree, victims);
+	
+	size_t bytesFreed = ReleaseResources(victims);
+	m_Evictions += victims.size();
+	m_EvictedBytes += bytesFreed;
+	return bytesFreed >= bytesToFree;
+}
+
+size_t ResourceManager::ReleaseResources(const std::vector<IResource*>& resources)
+{
+	//Forced releases can take a dependency and its dependents at once, so every reference is given back before anything is freed
+	for (IResource* resource : resources)
+		RemoveDependencyRefs(resource);
+
+	//The resources destructor calls UnloadResource, which would lock m_LockLoaded again
+	size_t bytesFreed = 0;
 	m_IsCleanup = true;
-	bool exit = false;
-	while (!exit)
+	for (IResource* resource : resources)
 	{
-		exit = true;
-		for (auto it = m_LoadedResources.begin(); it != m_LoadedResources.end(); it++)
-		{
-			IResource* res = it->second;
-			if (res->GetRefCount() == 0 || force)
-			{
-				m_LoadedResources.erase(it);
-				m_UsedMemory -= res->m_Size;
-				res->InternalRelease();
-				exit = false;
-				break;
-			}
-		}
+		EraseLoadedResource(resource);
+		UnlinkResource(resource);
+		m_UsedMemory -= resource->m_Size;
+		bytesFreed += resource->m_Size;
+		resource->InternalRelease();
 	}
 	m_IsCleanup = false;
+	return bytesFreed;
+}
+
+void ResourceManager::TouchResource(IResource* resource)
+{
+	resource->m_LastAccess = ++m_AccessTick;
+	resource->m_AccessCount++;
+
+	if (m_pMostRecent == resource)
+		return;
+
+	UnlinkResource(resource);
+	resource->m_pLessRecent = m_pMostRecent;
+	if (m_pMostRecent)
+		m_pMostRecent->m_pMoreRecent = resource;
+	
+	m_pMostRecent = resource;
+	if (!m_pLeastRecent)
+		m_pLeastRecent = resource;
+}
+
+void ResourceManager::TryTouchResource(IResource* resource)
+{
+	//Under contention the access is not recorded, which only makes the recency order approximate
+	if (!m_LockLoaded.try_lock())
+		return;
+
+	//The resource may have been evicted since it was looked up
+	if (m_LoadedResources.Find(resource->m_Guid) == resource)
+		TouchResource(resource);
+
+	m_LockLoaded.unlock();
+}
+
+void ResourceManager::UnlinkResource(IResource* resource)
+{
+	if (resource->m_pMoreRecent)
+		resource->m_pMoreRecent->m_pLessRecent = resource->m_pLessRecent;
+	else if (m_pMostRecent == resource)
+		m_pMostRecent = resource->m_pLessRecent;
+
+	if (resource->m_pLessRecent)
+		resource->m_pLessRecent->m_pMoreRecent = resource->m_pMoreRecent;
+	else if (m_pLeastRecent == resource)
+		m_pLeastRecent = resource->m_pMoreRecent;
+
+	resource->m_pMoreRecent = nullptr;
+	resource->m_pLessRecent = nullptr;
+}
+
+void ResourceManager::InsertLoadedResource(IResource* resource)
+{
+	m_LoadedResources.Insert(resource->m_Guid, resource);
+	for (size_t alias : resource->m_Aliases)
+		m_LoadedResources.Insert(alias, resource);
+
+	m_LoadedAliases += resource->m_Aliases.size();
 }
 
-void ResourceManager::Update()
+void ResourceManager::EraseLoadedResource(IResource* resource)
 {
-	if (m_ResourcesToInitiate.size() > 0)
+	m_LoadedResources.Erase(resource->m_Guid);
+	for (size_t alias : resource->m_Aliases)
+		m_LoadedResources.Erase(alias);
+
+	m_LoadedAliases -= resource->m_Aliases.size();
+}
+
+void ResourceManager::AddDependencyRefs(IResource* resource)
+{
+	for (size_t dependency : resource->m_Dependencies)
 	{
-		std::scoped_lock<SpinLock> lock(m_LockInitiate);
-		for (size_t guid : m_ResourcesToInitiate)
+		IResource* pDependency = m_LoadedResources.Find(dependency);
+		if (pDependency)
 		{
-			IResource* resource = GetStrongResource(guid);
-			if (resource)
-			{
-				resource->InternalInit();
-				resource->RemoveRef();
-			}
-				
+			pDependency->AddRef();
+			resource->m_DependencyRefs.push_back(pDependency);
 		}
-		m_ResourcesToInitiate.clear();
 	}
-}
-
-bool ResourceManager::IsResourceBeingLoadedInternal(size_t guid)
-{
-	return std::find(m_ResourcesToBeLoaded.begin(), m_ResourcesToBeLoaded.end(), guid) != m_ResourcesToBeLoaded.end();
 }
 
-bool ResourceManager::IsResourceLoaded(size_t guid)
+void ResourceManager::RemoveDependencyRefs(IResource* resource)
+{
+	//A dependency that was not loaded when the resource was may have been loaded by someone else since, its references
+	//are theirs. Dependencies that nothing else holds are left for the eviction policy
+	for (IResource* pDependency : resource->m_DependencyRefs)
+		pDependency->RemoveRef();
+
+	resource->m_DependencyRefs.clear();
+}
+
+bool ResourceManager::PinRequests(const std::vector<std::shared_ptr<LoadRequest>>& requests, std::vector<IResource*>& pins)
+{
+	//The references of the loads that succeeded are collected even if another failed, so that they are released as well
+	bool succeeded = true;
+	for (const std::shared_ptr<LoadRequest>& request : requests)
+	{
+		if (!request)
+			continue;
+
+		if (request->succeeded)
+			pins.push_back(request->pResource);
+		else
+			succeeded = false;
+	}
+
+	return succeeded;
+}
+
+void ResourceManager::ReleasePins(std::vector<IResource*>& pins)
+{
+	for (IResource* pResource : pins)
+		pResource->RemoveRef();
+
+	pins.clear();
+}
+
+void ResourceManager::SetEvictionPolicy(IEvictionPolicy* pPolicy)
+{
+	assert(pPolicy != nullptr);
+
+	std::scoped_lock<SpinLock> lock(m_LockLoaded);
+	delete m_pEvictionPolicy;
+	m_pEvictionPolicy = pPolicy;
+}
+
+const char* ResourceManager::GetEvictionPolicyName()
 {
 	std::scoped_lock<SpinLock> lock(m_LockLoaded);
-	return m_LoadedResources.find(guid) != m_LoadedResources.end();
+	return m_pEvictionPolicy->GetName();
+}
+
+bool ResourceManager::IsResourceLoaded(size_t guid)
+{
+	return m_LoadedResources.Find(guid) != nullptr;
 }
 
 bool ResourceManager::IsResourceLoaded(const std::string& path)
@@ -296,7 +709,7 @@ bool ResourceManager::IsResourceLoaded(const std::string& path)
 bool ResourceManager::IsResourceBeingLoaded(size_t guid)
 {
 	std::scoped_lock<SpinLock> lock(m_LockLoading);
-	return IsResourceBeingLoadedInternal(guid);
+	return m_InFlightLoads.find(guid) != m_InFlightLoads.end();
 }
 
 bool ResourceManager::IsResourceBeingLoaded(const std::string& path)
@@ -313,19 +726,9 @@ bool ResourceManager::UnloadResource(size_t guid)
 	if (resource->GetRefCount() == 1)
 	{
 		std::scoped_lock<SpinLock> lock(m_LockLoaded);
-		m_IsCleanup = true;
-		for (auto it = m_LoadedResources.begin(); it != m_LoadedResources.end(); ++it)
-		{
-			if (it->second == resource)
-			{
-				m_LoadedResources.erase(it);
-				m_UsedMemory -= resource->m_Size;
-				resource->InternalRelease();
-				m_IsCleanup = false;
-				return true;
-			}
-		}
-		m_IsCleanup = false;
+		resource->RemoveRef();
+		ReleaseResources({ resource });
+		return true;
 	}
     
 	resource->RemoveRef();
@@ -333,44 +736,371 @@ bool ResourceManager::UnloadResource(size_t guid)
     return false;
 }
 
-void ResourceManager::CreateResourcePackage(const std::string& directory, std::vector<char*>& fileNames)
+//Every line lists a file in the bundle, optionally followed by ':' and the files that it depends on. Lines starting with '#' are comments.
+static void ParseBundleManifest(const std::string& manifest, size_t bundleGuid, std::unordered_map<size_t, std::vector<size_t>>& dependencies)
 {
-	Archiver& archiver = Archiver::GetInstance();
-	ResourceLoader& resourceLoader = ResourceLoader::Get();
-
-	archiver.CreateUncompressedPackage();
-
-	void* data = mm_allocate(4096 * 4096 * 4, 1, "CreateResourcePackage");
-	for (const char* file : fileNames)
+	std::stringstream manifestStream(manifest);
+	std::string line;
+	while (std::getline(manifestStream, line))
 	{
-		std::string fileName = std::string(file);
-		std::string filePath = directory + fileName;
-		std::size_t index = fileName.find_last_of(".");
-		if (index == std::string::npos)
-		{
-			ThreadSafePrintf("Error! Tried to package a file without a type [%s]\n", file);
+		std::stringstream lineStream(line);
+		std::string member;
+		if (!(lineStream >> member) || member[0] == '#')
 			continue;
-		}
-		size_t typeHash = HashString(fileName.substr(index).c_str());
-		size_t bytesWritten = resourceLoader.WriteResourceToBuffer(filePath, data);
-		if (bytesWritten == ULLONG_MAX)
+
+		if (member.back() == ':')
+			member.pop_back();
+
+		size_t memberGuid = HashString(member.c_str());
+		dependencies[bundleGuid].push_back(memberGuid);
+
+		std::string dependency;
+		while (lineStream >> dependency)
 		{
-			ThreadSafePrintf("Error! Failed to package the following file [%s]\n", file);
-			continue;
+			if (dependency != ":")
+				dependencies[memberGuid].push_back(HashString(dependency.c_str()));
 		}
-		archiver.AddToUncompressedPackage(HashString(file), typeHash, bytesWritten, data);
 	}
-	mm_free(data);
-
-	archiver.SaveUncompressedPackage(PACKAGE_PATH);
-	archiver.CloseUncompressedPackage();
-
-	ThreadSafePrintf("ResourcePackage [%s] Created\n", PACKAGE_PATH);
 }
 
-size_t ResourceManager::GetMaxMemory() const
+static uint64_t GetModifiedTime(const std::string& filePath)
 {
-	return m_MaxMemory;
+	std::error_code error;
+	std::filesystem::file_time_type time = std::filesystem::last_write_time(filePath, error);
+	return error ? 0 : uint64_t(time.time_since_epoch().count());
+}
+
+static uint64_t HashSourceFile(const std::string& filePath)
+{
+	std::ifstream file(filePath, std::ios::in | std::ios::binary);
+	std::stringstream content;
+	content << file.rdbuf();
+	std::string contentString = content.str();
+	return XxHash::Hash64(contentString.data(), contentString.size());
+}
+
+//Dependencies are placed before the resources that need them, the same order the loads read them in
+static void OrderBundleMember(size_t guid, const std::unordered_map<size_t, std::string>& packagedFiles, const std::unordered_map<size_t, std::vector<size_t>>& dependencies, std::unordered_set<size_t>& ordered, std::vector<size_t>& order)
+{
+	if (packagedFiles.find(guid) == packagedFiles.end() || !ordered.insert(guid).second)
+		return;
+
+	auto it = dependencies.find(guid);
+	if (it != dependencies.end())
+	{
+		for (size_t dependency : it->second)
+			OrderBundleMember(dependency, packagedFiles, dependencies, ordered, order);
+	}
+
+	order.push_back(guid);
+}
+
+//Recorded entries come first, so a level load reads one stretch of the file. Entries that were not recorded are grouped
+//by the bundle they are in, which keeps loading a bundle sequential even in parts of the game that were not played
+static std::vector<size_t> OrderPackageEntries(const std::vector<size_t>& accessOrder, const std::unordered_map<size_t, std::string>& packagedFiles, const std::unordered_map<size_t, std::vector<size_t>>& dependencies, size_t bundleType)
+{
+	std::unordered_set<size_t> ordered;
+	std::vector<size_t> order;
+	for (size_t guid : accessOrder)
+	{
+		if (packagedFiles.find(guid) != packagedFiles.end() && ordered.insert(guid).second)
+			order.push_back(guid);
+	}
+
+	std::vector<size_t> bundles;
+	for (const std::pair<const size_t, std::string>& packagedFile : packagedFiles)
+	{
+		if (HashString(std::filesystem::path(packagedFile.second).extension().string().c_str()) == bundleType)
+			bundles.push_back(packagedFile.first);
+	}
+
+	std::sort(bundles.begin(), bundles.end());
+	for (size_t bundle : bundles)
+	{
+		auto it = dependencies.find(bundle);
+		if (it == dependencies.end())
+			continue;
+
+		for (size_t member : it->second)
+			OrderBundleMember(member, packagedFiles, dependencies, ordered, order);
+	}
+
+	return order;
+}
+
+void ResourceManager::StartAccessRecording()
+{
+	Archiver::GetInstance().SetAccessRecording(true);
+	m_IsRecordingAccess = true;
+}
+
+bool ResourceManager::StopAccessRecording()
+{
+	Archiver& archiver = Archiver::GetInstance();
+	archiver.SetAccessRecording(false);
+	m_IsRecordingAccess = false;
+
+	std::vector<size_t> accessOrder;
+	archiver.GetAccessOrder(accessOrder);
+
+	std::ofstream orderFile(PACKAGE_ACCESS_ORDER_PATH, std::ios::out | std::ios::trunc);
+	if (!orderFile.is_open())
+	{
+		ThreadSafePrintf("Failed to write the access order to [%s]!\n", PACKAGE_ACCESS_ORDER_PATH);
+		return false;
+	}
+
+	//Names keep the order valid for packages that are built from a different set of files
+	for (size_t guid : accessOrder)
+	{
+		std::string name = archiver.GetPackageEntryName(guid);
+		if (!name.empty())
+			orderFile << name << std::endl;
+	}
+
+	ThreadSafePrintf("Recorded the access order of %zu entries to [%s]\n", accessOrder.size(), PACKAGE_ACCESS_ORDER_PATH);
+	return true;
+}
+
+bool ResourceManager::IsRecordingAccess() const
+{
+	return m_IsRecordingAccess;
+}
+
+void ResourceManager::CreateResourcePackage(const std::string& directory, std::vector<char*>& fileNames, bool isIncremental, bool isOrderedByAccess)
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	Archiver& archiver = Archiver::GetInstance();
+	ResourceLoader& resourceLoader = ResourceLoader::Get();
+	std::unordered_map<size_t, std::vector<size_t>> dependencies;
+	std::unordered_map<size_t, std::string> packagedFiles;
+	Clock::time_point start = Clock::now();
+	size_t reusedEntries = 0;
+
+	archiver.CreateUncompressedPackage();
+
+	//Textures and meshes are large and loaded often, so they favour decode speed,
+	//bundle manifests are small text files that share most of their content
+	archiver.SetPackageCodec(HashString(".tga"), Archiver::CODEC_LZ4);
+	archiver.SetPackageCodec(HashString(".bmp"), Archiver::CODEC_LZ4);
+	archiver.SetPackageCodec(HashString(".obj"), Archiver::CODEC_LZ4);
+	archiver.SetPackageCodec(HashString(".dae"), Archiver::CODEC_LZ4);
+	archiver.SetPackageCodec(HashString(BUNDLE_FILE_EXTENSION), Archiver::CODEC_DEFLATE_DICTIONARY);
+
+	if (isIncremental && !archiver.OpenPreviousPackage(PACKAGE_PATH))
+		ThreadSafePrintf("No package to build [%s] incrementally from, every file is imported\n", PACKAGE_PATH);
+
+	void* data = mm_allocate(4096 * 4096 * 4, 1, "CreateResourcePackage");
+	for (const char* file : fileNames)
+	{
+		std::string fileName = std::string(file);
+		std::string filePath = directory + fileName;
+		std::size_t index = fileName.find_last_of(".");
+		if (index == std::string::npos)
+		{
+			ThreadSafePrintf("Error! Tried to package a file without a type [%s]\n", file);
+			continue;
+		}
+
+		size_t guid = HashString(file);
+		size_t typeHash = HashString(fileName.substr(index).c_str());
+		ILoader* loader = resourceLoader.GetLoader(typeHash);
+
+		//The source is only read to hash it when it has been written since the previous build
+		Archiver::PackageSourceInfo previousSource = {};
+		Archiver::PackageSourceInfo source = {};
+		bool hasPreviousSource = archiver.GetPreviousPackageSource(guid, previousSource);
+		source.modifiedTime = GetModifiedTime(filePath);
+		source.importerVersion = loader ? loader->GetVersion() : BUNDLE_IMPORTER_VERSION;
+		bool isTouched = !hasPreviousSource || source.modifiedTime == 0 || source.modifiedTime != previousSource.modifiedTime;
+
+		if (typeHash == HashString(BUNDLE_FILE_EXTENSION))
+		{
+			//The manifest is stored as is, its members are recorded as the bundle's dependencies
+			std::ifstream manifestFile(filePath, std::ios::in | std::ios::binary);
+			std::stringstream manifest;
+			manifest << manifestFile.rdbuf();
+			if (!manifestFile.is_open() || manifest.str().empty())
+			{
+				ThreadSafePrintf("Error! Failed to read bundle manifest [%s]\n", file);
+				continue;
+			}
+
+			//The members are listed in the manifest, so it is parsed even when the entry is copied
+			std::string manifestString = manifest.str();
+			ParseBundleManifest(manifestString, guid, dependencies);
+			source.sourceHash = XxHash::Hash64(manifestString.data(), manifestString.size());
+			bool isUnchanged = hasPreviousSource && source.sourceHash == previousSource.sourceHash && source.importerVersion == previousSource.importerVersion;
+			if (isUnchanged && archiver.AddFromPreviousPackage(guid, source))
+			{
+				reusedEntries++;
+			}
+			else
+			{
+				archiver.AddToUncompressedPackage(guid, typeHash, manifestString.size(), (void*)manifestString.data());
+				archiver.SetUncompressedPackageEntrySource(guid, source);
+			}
+		}
+		else
+		{
+			source.sourceHash = isTouched ? HashSourceFile(filePath) : previousSource.sourceHash;
+			bool isUnchanged = hasPreviousSource && source.sourceHash == previousSource.sourceHash && source.importerVersion == previousSource.importerVersion;
+			if (isUnchanged && archiver.AddFromPreviousPackage(guid, source))
+			{
+				reusedEntries++;
+			}
+			else
+			{
+				size_t bytesWritten = resourceLoader.WriteResourceToBuffer(filePath, data);
+				if (bytesWritten == ULLONG_MAX)
+				{
+					ThreadSafePrintf("Error! Failed to package the following file [%s]\n", file);
+					continue;
+				}
+
+				archiver.AddToUncompressedPackage(guid, typeHash, bytesWritten, data);
+				archiver.SetUncompressedPackageEntrySource(guid, source);
+			}
+
+			std::vector<std::string> loaderDependencies;
+			resourceLoader.GetResourceDependencies(filePath, loaderDependencies);
+			for (const std::string& dependency : loaderDependencies)
+				dependencies[guid].push_back(HashString(dependency.c_str()));
+		}
+
+		packagedFiles[guid] = fileName;
+	}
+	mm_free(data);
+
+	//Everything that is copied has been read, so the package can be written over
+	archiver.ClosePreviousPackage();
+
+	for (std::pair<const size_t, std::string>& packagedFile : packagedFiles)
+	{
+		std::vector<size_t>& entryDependencies = dependencies[packagedFile.first];
+		std::sort(entryDependencies.begin(), entryDependencies.end());
+		entryDependencies.erase(std::unique(entryDependencies.begin(), entryDependencies.end()), entryDependencies.end());
+
+		for (size_t dependency : entryDependencies)
+		{
+			if (packagedFiles.find(dependency) == packagedFiles.end())
+				ThreadSafePrintf("Warning! [%s] depends on a file that is not in the package\n", packagedFile.second.c_str());
+		}
+
+		archiver.SetUncompressedPackageEntryInfo(packagedFile.first, packagedFile.second, entryDependencies);
+	}
+
+	if (isOrderedByAccess)
+	{
+		std::vector<size_t> accessOrder;
+		std::ifstream orderFile(PACKAGE_ACCESS_ORDER_PATH, std::ios::in);
+		std::string name;
+		while (orderFile >> name)
+			accessOrder.push_back(HashString(name.c_str()));
+
+		if (accessOrder.empty())
+			ThreadSafePrintf("No access order recorded in [%s], only bundles are grouped\n", PACKAGE_ACCESS_ORDER_PATH);
+
+		archiver.SetPackageEntryOrder(OrderPackageEntries(accessOrder, packagedFiles, dependencies, HashString(BUNDLE_FILE_EXTENSION)));
+	}
+
+	archiver.SaveUncompressedPackage(PACKAGE_PATH);
+	archiver.CloseUncompressedPackage();
+
+	float buildTime = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+	ThreadSafePrintf("ResourcePackage [%s] Created in %.2f ms, %zu of %zu entries copied from the previous build\n", PACKAGE_PATH, buildTime, reusedEntries, packagedFiles.size());
+}
+
+bool ResourceManager::MountPackage(const std::string& filename, int32_t priority)
+{
+	return Archiver::GetInstance().MountPackage(filename, PACKAGE_MODE, priority);
+}
+
+bool ResourceManager::MountDirectory(const std::string& directory, int32_t priority)
+{
+	ResourceLoader& resourceLoader = ResourceLoader::Get();
+
+	//Picks the same files as the packaging tool
+	std::error_code error;
+	std::vector<Archiver::LooseFile> files;
+	for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directory, error))
+	{
+		std::string fileName = entry.path().filename().string();
+		std::string extension = entry.path().extension().string();
+		if (!entry.is_regular_file() || (!resourceLoader.HasLoaderForFile(fileName) && extension != BUNDLE_FILE_EXTENSION))
+			continue;
+
+		files.push_back({ HashString(fileName.c_str()), HashString(extension.c_str()), fileName });
+	}
+
+	if (error)
+	{
+		ThreadSafePrintf("Failed to mount [%s]!\n", directory.c_str());
+		return false;
+	}
+
+	ThreadSafePrintf("Mounted [%s] with %zu loose files\n", directory.c_str(), files.size());
+	return Archiver::GetInstance().MountDirectory(directory, files, priority, &ResourceManager::ImportLooseFile);
+}
+
+bool ResourceManager::Unmount(const std::string& path)
+{
+	return Archiver::GetInstance().Unmount(path);
+}
+
+void* ResourceManager::ImportLooseFile(size_t guid, const std::string& path, size_t& size, std::vector<size_t>& dependencies)
+{
+	ResourceLoader& resourceLoader = ResourceLoader::Get();
+	void* pData = nullptr;
+
+	if (std::filesystem::path(path).extension() == BUNDLE_FILE_EXTENSION)
+	{
+		std::ifstream manifestFile(path, std::ios::in | std::ios::binary);
+		std::stringstream manifest;
+		manifest << manifestFile.rdbuf();
+		std::string manifestString = manifest.str();
+		if (manifestString.empty())
+			return nullptr;
+
+		std::unordered_map<size_t, std::vector<size_t>> manifestDependencies;
+		ParseBundleManifest(manifestString, guid, manifestDependencies);
+		dependencies = manifestDependencies[guid];
+
+		size = manifestString.size();
+		pData = mm_allocate(size, 1, "Loose Bundle");
+		memcpy(pData, manifestString.data(), size);
+	}
+	else
+	{
+		//Loaders write into a buffer that fits any resource, the entry only keeps what was written
+		void* pScratch = mm_allocate(4096 * 4096 * 4, 1, "ImportLooseFile");
+		size_t bytesWritten = resourceLoader.WriteResourceToBuffer(path, pScratch);
+		if (bytesWritten != ULLONG_MAX)
+		{
+			size = bytesWritten;
+			pData = mm_allocate(std::max(size, size_t(1)), 1, "Loose File");
+			memcpy(pData, pScratch, size);
+		}
+		mm_free(pScratch);
+
+		if (!pData)
+			return nullptr;
+
+		std::vector<std::string> loaderDependencies;
+		resourceLoader.GetResourceDependencies(path, loaderDependencies);
+		for (const std::string& dependency : loaderDependencies)
+			dependencies.push_back(HashString(dependency.c_str()));
+	}
+
+	std::sort(dependencies.begin(), dependencies.end());
+	dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+	return pData;
+}
+
+size_t ResourceManager::GetMaxMemory() const
+{
+	return m_MaxMemory;
 }
 
 size_t ResourceManager::GetUsedMemory() const
@@ -378,39 +1108,462 @@ size_t ResourceManager::GetUsedMemory() const
 	return m_UsedMemory;
 }
 
+void ResourceManager::FinalizeResources(float budgetMilliseconds, size_t budgetBytes)
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	Clock::time_point start = Clock::now();
+	uint64_t profileStart = TaskProfiler::IsEnabled() ? TaskProfiler::Get().GetTimestamp() : 0;
+	
+	FinalizeStats stats = {};
+	do
+	{
+		size_t guid;
+		{
+			std::scoped_lock<SpinLock> lock(m_LockFinalize);
+			if (m_FinalizeQueue.empty())
+				break;
+
+			guid = m_FinalizeQueue.front();
+		}
+
+		//Look the resource up directly, uploading it is not a use that should affect eviction
+		IResource* resource = nullptr;
+		{
+			std::scoped_lock<SpinLock> lock(m_LockLoaded);
+			resource = m_LoadedResources.Find(guid);
+			if (resource)
+				resource->AddRef();
+		}
+
+		//Resources that were unloaded before they were finalized are just dropped
+		bool isFinished = true;
+		if (resource)
+		{
+			size_t bytesUploaded = 0;
+			isFinished = resource->InternalInitPartial(budgetBytes > stats.bytesUploaded ? budgetBytes - stats.bytesUploaded : 0, bytesUploaded);
+			stats.bytesUploaded += bytesUploaded;
+			resource->RemoveRef();
+		}
+
+		if (isFinished)
+		{
+			std::scoped_lock<SpinLock> lock(m_LockFinalize);
+			m_FinalizeQueue.pop_front();
+			if (resource)
+				stats.resourcesFinalized++;
+		}
+
+		stats.milliseconds = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+	} while (stats.milliseconds < budgetMilliseconds && stats.bytesUploaded < budgetBytes);
+
+	{
+		std::scoped_lock<SpinLock> lock(m_LockFinalize);
+		stats.resourcesPending = uint32_t(m_FinalizeQueue.size());
+	}
+
+	m_FinalizeStats = stats;
+	m_PeakFinalizeMilliseconds = std::max(m_PeakFinalizeMilliseconds, stats.milliseconds);
+
+	if (profileStart > 0 && stats.bytesUploaded > 0)
+		TaskProfiler::Get().RecordTask("FinalizeResources", TaskManager::PRIORITY_CRITICAL, profileStart, profileStart, TaskProfiler::Get().GetTimestamp());
+}
+
+const ResourceManager::FinalizeStats& ResourceManager::GetFinalizeStats() const
+{
+	return m_FinalizeStats;
+}
+
+float ResourceManager::GetPeakFinalizeMilliseconds() const
+{
+	return m_PeakFinalizeMilliseconds;
+}
+
+void ResourceManager::RequestStreaming(const std::string& file, float priority)
+{
+	AddStreamingRequest(file, priority, false);
+}
+
+void ResourceManager::RequestStreaming(const std::string& file, const Camera& camera, const glm::vec3& position)
+{
+	float distance = glm::length(position - camera.GetPosition());
+
+	//Outside of the view frustum the resource is not visible yet, but probably will be soon
+	glm::vec4 clip = camera.GetProjection() * camera.GetView() * glm::vec4(position, 1.0f);
+	bool isInView = clip.w > 0.0f && std::abs(clip.x) <= clip.w && std::abs(clip.y) <= clip.w && clip.z <= clip.w;
+	AddStreamingRequest(file, distance, !isInView);
+}
+
+void ResourceManager::PrefetchResource(const std::string& file, float priority)
+{
+	AddStreamingRequest(file, priority, true);
+}
+
+ResourceManager::StreamingRequest& ResourceManager::AddStreamingRequest(const std::string& file, float priority, bool isPrefetch)
+{
+	size_t guid = HashString(file.c_str());
+	auto iterator = m_StreamingRequests.find(guid);
+	if (iterator == m_StreamingRequests.end())
+	{
+		iterator = m_StreamingRequests.emplace(guid, StreamingRequest()).first;
+		StreamingRequest& request = iterator->second;
+		request.file = file;
+		request.isPrefetch = true;
+		request.isVisible = false;
+		request.state = StreamingRequest::STATE_QUEUED;
+		request.requestTime = std::chrono::high_resolution_clock::now();
+	}
+
+	StreamingRequest& request = iterator->second;
+	//Time to visible is measured from when the resource was first needed, a finished prefetch counts as instant
+	if (request.isPrefetch && !isPrefetch)
+	{
+		request.isPrefetch = false;
+		request.requestTime = std::chrono::high_resolution_clock::now();
+	}
+
+	request.priority = priority;
+	request.lastRequestedFrame = m_StreamingFrame;
+	return request;
+}
+
+bool ResourceManager::IsResourceReady(size_t guid)
+{
+	std::scoped_lock<SpinLock> lock(m_LockLoaded);
+	IResource* resource = m_LoadedResources.Find(guid);
+	return resource && resource->IsReady();
+}
+
+void ResourceManager::UpdateStreaming()
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	m_StreamingFrame++;
+	m_StreamingStats.requestsQueued = 0;
+	m_StreamingStats.requestsLoading = 0;
+	m_StreamingStats.prefetchesDeferred = 0;
+
+	uint32_t loading = 0;
+	m_StreamingQueue.clear();
+	for (auto iterator = m_StreamingRequests.begin(); iterator != m_StreamingRequests.end();)
+	{
+		StreamingRequest& request = iterator->second;
+		if (request.state == StreamingRequest::STATE_LOADING)
+		{
+			if (!request.load->IsFinished())
+			{
+				loading++;
+				iterator++;
+				continue;
+			}
+
+			request.bundle = request.load->Wait();
+			request.load.reset();
+			request.state = request.bundle ? StreamingRequest::STATE_LOADED : StreamingRequest::STATE_FAILED;
+		}
+
+		//Dropping the bundle makes the resources evictable, loads that have not been started are just forgotten
+		if (m_StreamingFrame - request.lastRequestedFrame > STREAMING_REQUEST_LIFETIME)
+		{
+			if (!request.isVisible && !request.isPrefetch)
+				m_StreamingStats.requestsCancelled++;
+
+			iterator = m_StreamingRequests.erase(iterator);
+			continue;
+		}
+
+		if (request.state == StreamingRequest::STATE_QUEUED)
+		{
+			m_StreamingQueue.push_back(&request);
+		}
+		else if (request.state == StreamingRequest::STATE_LOADED && !request.isPrefetch && !request.isVisible && IsResourceReady(iterator->first))
+		{
+			float timeToVisible = std::chrono::duration<float, std::milli>(Clock::now() - request.requestTime).count();
+			request.isVisible = true;
+			m_TotalTimeToVisible += timeToVisible;
+			m_StreamingStats.resourcesVisible++;
+			m_StreamingStats.averageTimeToVisible = m_TotalTimeToVisible / m_StreamingStats.resourcesVisible;
+			m_StreamingStats.maxTimeToVisible = std::max(m_StreamingStats.maxTimeToVisible, timeToVisible);
+		}
+
+		iterator++;
+	}
+
+	//Requested resources come before prefetches, then the lowest priority value first
+	auto isLessImportant = [](const StreamingRequest* pFirst, const StreamingRequest* pSecond)
+	{
+		if (pFirst->isPrefetch != pSecond->isPrefetch)
+			return pFirst->isPrefetch;
+
+		return pFirst->priority > pSecond->priority;
+	};
+	std::make_heap(m_StreamingQueue.begin(), m_StreamingQueue.end(), isLessImportant);
+
+	Archiver& archiver = Archiver::GetInstance();
+	if (!m_StreamingQueue.empty())
+		archiver.OpenCompressedPackage(PACKAGE_PATH, PACKAGE_MODE);
+
+	size_t prefetchBudget = size_t(m_MaxMemory * STREAMING_PREFETCH_MEMORY_FRACTION);
+	size_t prefetchMemory = m_UsedMemory;
+	while (!m_StreamingQueue.empty() && loading < STREAMING_MAX_IN_FLIGHT)
+	{
+		std::pop_heap(m_StreamingQueue.begin(), m_StreamingQueue.end(), isLessImportant);
+		StreamingRequest* pRequest = m_StreamingQueue.back();
+		m_StreamingQueue.pop_back();
+
+		if (pRequest->isPrefetch)
+		{
+			//Memory of loads that are still running is not counted in m_UsedMemory yet
+			size_t size = archiver.ReadRequiredSizeForPackageData(HashString(pRequest->file.c_str()));
+			if (prefetchMemory + size > prefetchBudget)
+			{
+				m_StreamingStats.prefetchesDeferred++;
+				continue;
+			}
+
+			prefetchMemory += size;
+		}
+
+		pRequest->load = std::make_unique<AsyncTask<Ref<ResourceBundle>>>(LoadAsync({ pRequest->file }));
+		pRequest->load->Start();
+		pRequest->state = StreamingRequest::STATE_LOADING;
+		loading++;
+	}
+
+	m_StreamingStats.requestsQueued = uint32_t(m_StreamingQueue.size()) + m_StreamingStats.prefetchesDeferred;
+	m_StreamingStats.requestsLoading = loading;
+}
+
+void ResourceManager::CancelStreaming()
+{
+	for (std::pair<const size_t, StreamingRequest>& request : m_StreamingRequests)
+	{
+		if (request.second.load)
+			request.second.load->Wait();
+	}
+
+	m_StreamingRequests.clear();
+	m_StreamingQueue.clear();
+}
+
+const ResourceManager::StreamingStats& ResourceManager::GetStreamingStats() const
+{
+	return m_StreamingStats;
+}
+
+bool ResourceManager::EnableHotReload(const std::vector<std::string>& directories)
+{
+#ifdef __linux__
+	if (m_IsHotReloading)
+		return true;
+
+	int inotifyHandle = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyHandle < 0)
+	{
+		ThreadSafePrintf("Failed to initialize inotify for hot reload!\n");
+		return false;
+	}
+
+	//Editors often save to a temporary file and rename it, so moves count as changes as well
+	std::unordered_map<int, std::string> watches;
+	for (const std::string& directory : directories)
+	{
+		int watch = inotify_add_watch(inotifyHandle, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (watch < 0)
+		{
+			ThreadSafePrintf("Failed to watch [%s] for hot reload!\n", directory.c_str());
+			continue;
+		}
+
+		watches.insert({ watch, directory });
+	}
+
+	if (watches.empty())
+	{
+		close(inotifyHandle);
+		return false;
+	}
+
+	m_IsHotReloading = true;
+	m_HotReloadThread = std::thread(&ResourceManager::WatchDirectories, this, inotifyHandle, std::move(watches));
+	ThreadSafePrintf("Hot reload enabled\n");
+	return true;
+#else
+	ThreadSafePrintf("Hot reload is only supported on Linux!\n");
+	return false;
+#endif
+}
+
+void ResourceManager::DisableHotReload()
+{
+	m_IsHotReloading = false;
+	if (m_HotReloadThread.joinable())
+		m_HotReloadThread.join();
+}
+
+bool ResourceManager::IsHotReloadEnabled() const
+{
+	return m_IsHotReloading;
+}
+
+void ResourceManager::WatchDirectories(int inotifyHandle, std::unordered_map<int, std::string> directories)
+{
+#ifdef __linux__
+	alignas(inotify_event) char buffer[4096];
+	while (m_IsHotReloading)
+	{
+		pollfd descriptor = { inotifyHandle, POLLIN, 0 };
+		if (poll(&descriptor, 1, HOT_RELOAD_POLL_MS) <= 0)
+			continue;
+
+		//Saving a file usually produces several events, every file is only reloaded once per batch
+		std::unordered_map<size_t, std::string> changedFiles;
+		ssize_t length = 0;
+		while ((length = read(inotifyHandle, buffer, sizeof(buffer))) > 0)
+		{
+			for (char* pPosition = buffer; pPosition < buffer + length;)
+			{
+				const inotify_event* pEvent = (const inotify_event*)pPosition;
+				auto directory = directories.find(pEvent->wd);
+				if (pEvent->len > 0 && directory != directories.end())
+				{
+					const char* name = pEvent->name;
+					changedFiles[HashString(name)] = directory->second + "/" + name;
+				}
+
+				pPosition += sizeof(inotify_event) + pEvent->len;
+			}
+		}
+
+		//Resources that are not loaded are skipped, the package itself is not rebuilt
+		for (std::pair<const size_t, std::string>& file : changedFiles)
+		{
+			if (!IsResourceLoaded(file.first))
+				continue;
+
+			size_t guid = file.first;
+			std::string path = file.second;
+			TaskManager::Get().Execute([this, guid, path] { ReloadResource(guid, path); }, TaskManager::PRIORITY_BACKGROUND, "HotReload");
+		}
+	}
+
+	close(inotifyHandle);
+#endif
+}
+
+void ResourceManager::ReloadResource(size_t guid, const std::string& path)
+{
+	IResource* pReloaded = ResourceLoader::Get().LoadResourceFromDisk(path);
+	if (!pReloaded)
+	{
+		ThreadSafePrintf("Failed to reload [%s]!\n", path.c_str());
+		return;
+	}
+
+	//The renderer and the GPU data live on the main thread, swapping there makes the change atomic to them
+	TaskManager::Get().ExecuteOnMainThread([this, guid, pReloaded, path] { SwapReloadedResource(guid, pReloaded, path); }, "HotReload swap");
+}
+
+void ResourceManager::SwapReloadedResource(size_t guid, IResource* pReloaded, const std::string& path)
+{
+	bool isReloaded = false;
+	bool isShared = false;
+	{
+		std::scoped_lock<SpinLock> lock(m_LockLoaded);
+		IResource* resource = m_LoadedResources.Find(guid);
+
+		//Identical files share one resource, swapping the edit in would change all of them. References to it are
+		//released by looking their GUID up again, so it can not be split off either without unbalancing them
+		isShared = resource && (resource->m_Guid != guid || !resource->m_Aliases.empty());
+		isReloaded = resource && !isShared && resource->InternalReload(pReloaded);
+
+		//An edit can grow or shrink the resource, the eviction budget has to follow it
+		if (isReloaded)
+		{
+			size_t size = resource->GetPayloadSize();
+			if (size > resource->m_Size)
+				m_UsedMemory += size - resource->m_Size;
+			else
+				m_UsedMemory -= resource->m_Size - size;
+
+			resource->m_Size = size;
+		}
+	}
+
+	if (isReloaded)
+	{
+		//Only this resource is uploaded again, spread over frames like any other load
+		std::scoped_lock<SpinLock> lock(m_LockFinalize);
+		m_FinalizeQueue.push_back(guid);
+		ThreadSafePrintf("Reloaded [%s]\n", path.c_str());
+	}
+	else if (isShared)
+	{
+		ThreadSafePrintf("Skipped reloading [%s], it shares its resource with identical files until the package is rebuilt!\n", path.c_str());
+	}
+	else
+	{
+		ThreadSafePrintf("Failed to swap in reloaded [%s]!\n", path.c_str());
+	}
+
+	//Now holds the replaced GPU data, which has to be deleted on the main thread
+	delete pReloaded;
+}
+
+size_t ResourceManager::GetCacheHits() const
+{
+	return m_CacheHits;
+}
+
+size_t ResourceManager::GetCacheMisses() const
+{
+	return m_CacheMisses;
+}
+
+size_t ResourceManager::GetEvictions() const
+{
+	return m_Evictions;
+}
+
+size_t ResourceManager::GetEvictedBytes() const
+{
+	return m_EvictedBytes;
+}
+
 size_t ResourceManager::GetNrOfResourcesLoaded() const
 {
-	return m_LoadedResources.size();
+	return m_LoadedResources.GetSize() - m_LoadedAliases;
 }
 
 size_t ResourceManager::GetNrOfResourcesInUse() const
 {
 	size_t resourcesInUse = 0;
-	for(std::pair<size_t, IResource*> resource : m_LoadedResources)
+	m_LoadedResources.ForEach([&](size_t guid, IResource* resource)
 	{
-		if (resource.second->GetRefCount() > 0)
+		if (guid == resource->m_Guid && resource->GetRefCount() > 0)
 			resourcesInUse++;
-	}
+	});
 	return resourcesInUse;
 }
 
 void ResourceManager::GetResourcesInUse(std::vector<IResource*>& vector)
 {
 	std::scoped_lock<SpinLock> lock(m_LockLoaded);
-	for (std::pair<size_t, IResource*> resource : m_LoadedResources)
+	m_LoadedResources.ForEach([&](size_t guid, IResource* resource)
 	{
-		if (resource.second->GetRefCount() > 0)
-			vector.push_back(resource.second);
-	}
+		if (guid == resource->m_Guid && resource->GetRefCount() > 0)
+			vector.push_back(resource);
+	});
 }
 
 void ResourceManager::GetResourcesLoaded(std::vector<IResource*>& vector)
 {
 	std::scoped_lock<SpinLock> lock(m_LockLoaded);
-	for (std::pair<size_t, IResource*> resource : m_LoadedResources)
+	m_LoadedResources.ForEach([&](size_t guid, IResource* resource)
 	{
-		vector.push_back(resource.second);
-	}
+		if (guid == resource->m_Guid)
+			vector.push_back(resource);
+	});
 }
 
 ResourceManager& ResourceManager::Get()
@@ -6,16 +6,39 @@
 #include "IResource.h"
 #include <algorithm>
 #include <functional>
+#include <memory>
+#include <deque>
+#include <climits>
+#include <chrono>
+#include <glm/glm.hpp>
+#include <thread>
 #include "SpinLock.h"
 #include "Ref.h"
+#include "AsyncTask.h"
+#include "ConcurrentResourceTable.h"
+#include "Archiver.h"
 
 
 #define PACKAGE_PATH "package"
+#define PACKAGE_MODE Archiver::LOAD_MAPPED
+#define BUNDLE_FILE_EXTENSION ".bundle"
+//Names of the package entries in the order a play session first read them
+#define PACKAGE_ACCESS_ORDER_PATH "package.order"
+//Bundle manifests have no loader, this takes the place of its version in incremental package builds
+#define BUNDLE_IMPORTER_VERSION 1
+#define DEPENDENCY_VISITING INT32_MIN
 #define RESOURCE_MANAGER_MAX_MEMORY 4096 * 4096 * 3
+#define RESOURCE_FINALIZE_BUDGET_MS 2.0f
+#define RESOURCE_FINALIZE_BUDGET_BYTES 4 * 1024 * 1024
+#define HOT_RELOAD_POLL_MS 100
+#define STREAMING_MAX_IN_FLIGHT 4
+#define STREAMING_REQUEST_LIFETIME 30
+#define STREAMING_PREFETCH_MEMORY_FRACTION 0.75f
 
 class ResourceLoader;
-class Archiver;
 class ResourceBundle;
+class IEvictionPolicy;
+class Camera;
 
 class ResourceManager
 {
@@ -23,11 +46,120 @@ class ResourceManager
 	friend class IResource;
 	friend class Game;
 
+	//One load of a GUID that every requester attaches to, pending is zero once the load has finished
+	struct LoadRequest
+	{
+		std::atomic<size_t> pending = 1;
+		bool succeeded = false;
+		//Everyone that waits for the load is handed its own reference to the resource, so it can not be evicted before they use it
+		uint32_t nrOfRequesters = 1;
+		IResource* pResource = nullptr;
+		SpinLock lock;
+		std::vector<std::coroutine_handle<>> waiters;
+	};
+
+	//A resource the game wants streamed in, it is cancelled when it has not been requested for STREAMING_REQUEST_LIFETIME frames
+	struct StreamingRequest
+	{
+		enum State
+		{
+			STATE_QUEUED,
+			STATE_LOADING,
+			STATE_LOADED,
+			STATE_FAILED
+		};
+
+		std::string file;
+		float priority;
+		bool isPrefetch;
+		bool isVisible;
+		State state;
+		uint64_t lastRequestedFrame;
+		std::chrono::high_resolution_clock::time_point requestTime;
+		std::unique_ptr<AsyncTask<Ref<ResourceBundle>>> load;
+		Ref<ResourceBundle> bundle;
+	};
+
+	struct ResolvedResource
+	{
+		size_t guid;
+		std::string file;
+	};
+
+	//What happens to the buffer an entry is read into
+	enum LoadBuffer : unsigned char
+	{
+		//Freed once the loader has copied what it needs
+		BUFFER_TEMPORARY,
+		//Points into the mapped package and is never freed
+		BUFFER_VIEW,
+		//Allocated by the loader and owned by the resource once it is created
+		BUFFER_STORAGE
+	};
+
+	struct BatchedLoad
+	{
+		size_t resolvedIndex;
+		size_t readIndex;
+		void* data;
+		size_t size;
+		size_t typeHash;
+		LoadBuffer buffer;
+	};
+
+	struct LoadRequestAwaiter
+	{
+		inline bool await_ready() const noexcept
+		{
+			return request->pending.load(std::memory_order_acquire) == 0;
+		}
+
+		inline bool await_suspend(std::coroutine_handle<> handle)
+		{
+			std::scoped_lock<SpinLock> lock(request->lock);
+			if (request->pending.load(std::memory_order_acquire) == 0)
+				return false;
+
+			request->waiters.push_back(handle);
+			return true;
+		}
+
+		inline bool await_resume() const noexcept
+		{
+			return request->succeeded;
+		}
+
+		std::shared_ptr<LoadRequest> request;
+	};
+
+public:
+	struct FinalizeStats
+	{
+		float milliseconds;
+		size_t bytesUploaded;
+		uint32_t resourcesFinalized;
+		uint32_t resourcesPending;
+	};
+
+	struct StreamingStats
+	{
+		float averageTimeToVisible;
+		float maxTimeToVisible;
+		uint32_t resourcesVisible;
+		uint32_t requestsQueued;
+		uint32_t requestsLoading;
+		uint32_t requestsCancelled;
+		uint32_t prefetchesDeferred;
+	};
+
 public:
 	~ResourceManager();
 
 	Ref<ResourceBundle> LoadResources(std::vector<std::string> files);
 
+	//Suspends the awaiting coroutine until all resources are loaded, the bundle is empty if loading failed
+	AsyncTask<Ref<ResourceBundle>> LoadAsync(std::vector<std::string> files);
+
 	void LoadResourcesInBackground(std::vector<std::string> files, const std::function<void(const Ref<ResourceBundle>&)>& callback);
 	IResource* GetResource(size_t guid);
 	IResource* GetResource(const std::string& file);
@@ -43,10 +175,60 @@ public:
 
 	bool UnloadResource(size_t guid);
 
-	void CreateResourcePackage(const std::string& directory, std::vector<char*>& fileNames);
+	//An incremental build copies the entries whose source and importer have not changed from the existing package.
+	//Ordering by access writes the entries in the recorded order, followed by the members of each bundle together
+	void CreateResourcePackage(const std::string& directory, std::vector<char*>& fileNames, bool isIncremental = false, bool isOrderedByAccess = false);
+
+	//Records the order in which resources are read from the packages during a play session
+	void StartAccessRecording();
+	//Writes the recorded order to PACKAGE_ACCESS_ORDER_PATH
+	bool StopAccessRecording();
+	bool IsRecordingAccess() const;
+
+	//The base package is mounted at PACKAGE_BASE_PRIORITY, patches and DLC mounted above it override its entries with the same GUID.
+	//Resources that are already loaded keep the data they were loaded from. Must not be called while resources are loading
+	bool MountPackage(const std::string& filename, int32_t priority);
+	//Development mode, the files in the directory are imported from disk when they are loaded. Dependencies that a bundle
+	//manifest lists for its members only apply to packaged files
+	bool MountDirectory(const std::string& directory, int32_t priority);
+	bool Unmount(const std::string& path);
+
+	//Runs the GPU uploads of loaded resources on the main thread until one of the budgets is spent.
+	//Large resources are uploaded over several frames, at least one step is taken every call.
+	void FinalizeResources(float budgetMilliseconds, size_t budgetBytes);
+	const FinalizeStats& GetFinalizeStats() const;
+	float GetPeakFinalizeMilliseconds() const;
+
+	//Streaming, main thread only. Requests with lower priority values are loaded first and have to be renewed every frame.
+	//The bundle is held until the request goes stale, after that the resources can be evicted again.
+	void RequestStreaming(const std::string& file, float priority);
+	//Resources in view of the camera are requested by distance, everything else is prefetched
+	void RequestStreaming(const std::string& file, const Camera& camera, const glm::vec3& position);
+	//Only loaded when no requested resource is waiting and it fits within STREAMING_PREFETCH_MEMORY_FRACTION of the memory budget
+	void PrefetchResource(const std::string& file, float priority);
+	//Starts the most important loads, cancels stale requests and measures the time until requested resources are ready
+	void UpdateStreaming();
+	//Waits for streaming loads that are still running and drops every request
+	void CancelStreaming();
+	const StreamingStats& GetStreamingStats() const;
+
+	//Development mode, loaded resources whose source file in one of the directories changes are re-imported on a worker
+	//and swapped in on the main thread. Existing references keep pointing at the same resource. Files that share their
+	//resource with identical package entries are skipped, the edit would show up in all of them. Only supported on Linux.
+	bool EnableHotReload(const std::vector<std::string>& directories);
+	void DisableHotReload();
+	bool IsHotReloadEnabled() const;
+
+	//Takes ownership of the policy, LRU is used by default
+	void SetEvictionPolicy(IEvictionPolicy* pPolicy);
+	const char* GetEvictionPolicyName();
 
 	size_t GetMaxMemory() const;
 	size_t GetUsedMemory() const;
+	size_t GetCacheHits() const;
+	size_t GetCacheMisses() const;
+	size_t GetEvictions() const;
+	size_t GetEvictedBytes() const;
 	size_t GetNrOfResourcesLoaded() const;
 	size_t GetNrOfResourcesInUse() const;
 
@@ -58,21 +240,91 @@ public:
 private:
 	ResourceManager();
 
-	bool LoadResource(ResourceLoader& resourceLoader, Archiver& archiver, size_t guid, const std::string& file);
-	void BackgroundLoading(std::vector<std::string> files, const std::function<void(const Ref<ResourceBundle>&)>& callback);
+	//Attaches to or takes over the load of every resource in the level and prepares the owned ones, their reads are
+	//collected so the whole level can be read in one package batch
+	void StartLevel(ResourceLoader& resourceLoader, Archiver& archiver, const std::vector<ResolvedResource>& level, std::vector<std::shared_ptr<LoadRequest>>& requests, std::vector<IResource*>& pins, std::vector<BatchedLoad>& loads, std::vector<Archiver::PackageRead>& reads);
+	//Creates the owned resources in parallel once the batch is read and completes their loads
+	void FinishLevel(ResourceLoader& resourceLoader, const std::vector<ResolvedResource>& level, const std::vector<std::shared_ptr<LoadRequest>>& requests, std::vector<BatchedLoad>& loads, const std::vector<Archiver::PackageRead>& reads);
+	//Returns a view into the package when the entry can be used in place, or the loader's own storage when it can keep
+	//the entry as is, and a temporary buffer otherwise
+	void* PrepareLoad(ResourceLoader& resourceLoader, Archiver& archiver, size_t guid, const std::string& file, size_t& size, size_t& typeHash, LoadBuffer& buffer);
+	//The created resource holds a reference for the load, which CompleteLoad hands on to a requester
+	IResource* FinishLoad(ResourceLoader& resourceLoader, size_t guid, const std::string& file, void* data, size_t size, size_t typeHash, LoadBuffer buffer);
+	
+	//Expands bundles and dependencies into levels where every resource only depends on earlier levels
+	bool ResolveDependencies(Archiver& archiver, const std::vector<std::string>& files, std::vector<std::vector<ResolvedResource>>& levels);
+	bool ResolveDependency(Archiver& archiver, size_t guid, const std::string& file, std::unordered_map<size_t, int32_t>& depths, std::vector<std::vector<ResolvedResource>>& levels, int32_t& depth);
+	Ref<ResourceBundle> CreateBundle(const std::vector<std::vector<ResolvedResource>>& levels);
+	//Collects the references the requests of a level were handed, they hold the level until CreateBundle has taken its own.
+	//Returns false if one of the loads failed
+	bool PinRequests(const std::vector<std::shared_ptr<LoadRequest>>& requests, std::vector<IResource*>& pins);
+	void ReleasePins(std::vector<IResource*>& pins);
+	DetachedTask BackgroundLoading(std::vector<std::string> files, std::function<void(const Ref<ResourceBundle>&)> callback);
 	void UnloadResource(IResource* resource);
 	void UnloadUnusedResources(bool force = false);
-	void Update();
+	//Evicts unused resources chosen by the eviction policy until bytesToFree has been released
+	bool EvictResources(size_t bytesToFree);
+	size_t ReleaseResources(const std::vector<IResource*>& resources);
 
-	bool IsResourceBeingLoadedInternal(size_t guid);
+	//Has to be called with m_LockLoaded held
+	void TouchResource(IResource* resource);
+	//Moves the resource to the front of the recency list unless a writer holds the lock, readers never wait on it
+	void TryTouchResource(IResource* resource);
+	void UnlinkResource(IResource* resource);
+	//Has to be called with m_LockLoaded held, also adds or removes the aliases of the resource
+	void InsertLoadedResource(IResource* resource);
+	void EraseLoadedResource(IResource* resource);
+	//A loaded resource holds a reference to each of its dependencies that was loaded with it, and releases exactly those
+	void AddDependencyRefs(IResource* resource);
+	void RemoveDependencyRefs(IResource* resource);
 
-	std::unordered_map<size_t, IResource*> m_LoadedResources;
-	std::vector<size_t> m_ResourcesToBeLoaded;
-	std::vector<size_t> m_ResourcesToInitiate;
+	//Returns nullptr if the resource already is loaded and hands back a reference to it in pLoaded,
+	//isOwner is set if the caller has to perform the load
+	std::shared_ptr<LoadRequest> AcquireLoad(size_t guid, bool& isOwner, IResource*& pLoaded);
+	//pResource is nullptr if the load failed
+	void CompleteLoad(size_t guid, const std::shared_ptr<LoadRequest>& request, IResource* pResource);
+
+	void WatchDirectories(int inotifyHandle, std::unordered_map<int, std::string> directories);
+	void ReloadResource(size_t guid, const std::string& path);
+	//Imports a file of a mounted directory into the form it would have in a package
+	static void* ImportLooseFile(size_t guid, const std::string& path, size_t& size, std::vector<size_t>& dependencies);
+	void SwapReloadedResource(size_t guid, IResource* pReloaded, const std::string& path);
+
+	StreamingRequest& AddStreamingRequest(const std::string& file, float priority, bool isPrefetch);
+	//Does not touch the resource, checking it is not a use
+	bool IsResourceReady(size_t guid);
+
+	//Written with m_LockLoaded held, lookups do not take the lock. Aliases have their own slots pointing at the shared resource
+	ConcurrentResourceTable m_LoadedResources;
+	std::atomic_size_t m_LoadedAliases;
+	std::unordered_map<size_t, std::shared_ptr<LoadRequest>> m_InFlightLoads;
 	SpinLock m_LockLoading;
 	SpinLock m_LockLoaded;
-	SpinLock m_LockInitiate;
 	bool m_IsCleanup;
 	size_t m_MaxMemory;
 	std::atomic_uint64_t m_UsedMemory;
+
+	IResource* m_pMostRecent;
+	IResource* m_pLeastRecent;
+	uint64_t m_AccessTick;
+	IEvictionPolicy* m_pEvictionPolicy;
+	std::atomic_uint64_t m_CacheHits;
+	std::atomic_uint64_t m_CacheMisses;
+	std::atomic_uint64_t m_Evictions;
+	std::atomic_uint64_t m_EvictedBytes;
+
+	std::deque<size_t> m_FinalizeQueue;
+	SpinLock m_LockFinalize;
+	FinalizeStats m_FinalizeStats;
+	float m_PeakFinalizeMilliseconds;
+
+	std::unordered_map<size_t, StreamingRequest> m_StreamingRequests;
+	std::vector<StreamingRequest*> m_StreamingQueue;
+	uint64_t m_StreamingFrame;
+	StreamingStats m_StreamingStats;
+	float m_TotalTimeToVisible;
+
+	std::thread m_HotReloadThread;
+	std::atomic_bool m_IsHotReloading;
+	bool m_IsRecordingAccess;
 };
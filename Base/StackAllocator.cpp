@@ -8,7 +8,9 @@ StackAllocator::StackAllocator(size_t size)
 	: m_Used(0),
     m_Size(size)
 {
-	m_pStart = mm_allocate(size, 1, "Stack Allocation Chunk");
+	//Page aligned so that the whole stack can be placed on the owning thread's NUMA node
+	m_pStart = mm_allocate(size, MEMORY_PAGE_SIZE, "Stack Allocation Chunk");
+	MemoryManager::BindToNumaNode(m_pStart, size, MemoryManager::GetThreadNumaNode());
 	m_pEnd = (void*)((size_t)m_pStart + size);
 	m_pCurrent = m_pStart;
 
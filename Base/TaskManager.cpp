@@ -1,53 +1,96 @@
 #include "TaskManager.h"
+#include "MemoryManager.h"
+#include "TaskProfiler.h"
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <algorithm>
+#include <chrono>
 
-void TaskManager::TaskThread()
+#if defined(_WIN32)
+	#define WIN32_LEAN_AND_MEAN 1
+	#define NOMINMAX 1
+	#include <windows.h>
+#elif defined(__linux__)
+	#include <pthread.h>
+	#include <sched.h>
+#endif
+
+static bool PinThreadToCore(std::thread& thread, uint32_t core)
+{
+#if defined(_WIN32)
+	if (core >= 64)
+		return false;
+
+	return SetThreadAffinityMask((HANDLE)thread.native_handle(), DWORD_PTR(1) << core) != 0;
+#elif defined(__linux__)
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	CPU_SET(core, &cpuSet);
+	return pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuSet) == 0;
+#else
+	//MacOS does not support pinning threads to cores
+	return false;
+#endif
+}
+
+
+void TaskManager::WorkerThread(Worker* pWorker)
 {
-	while (TaskManager::Get().ShouldRunWorker())
+	s_WorkerIndex = int32_t(pWorker->index);
+	MemoryManager::SetThreadNumaNode(pWorker->numaNode);
+
+	while (pWorker->isRunning.load())
 	{
-		std::function<void()> task;
-		if (TaskManager::Get().Poptask(task))
+		if (ExecuteNextTask())
 		{
 			//ThreadSafePrint("Took Task");
-
-			task();
-			TaskManager::Get().m_FinishedFence.fetch_add(1);
 		}
 		else
 		{
 			//ThreadSafePrint("No task goin to sleep");
 
-			std::unique_lock<std::mutex> lock(TaskManager::Get().m_Mutex);
-			TaskManager::Get().m_WakeCondition.wait(lock);
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_NumSleepingWorkers++;
+			m_WakeCondition.wait(lock, [this, pWorker]
+			{
+				return m_NumQueuedTasks.load() > 0 || !pWorker->isRunning.load();
+			});
+			m_NumSleepingWorkers--;
 		}
 	}
     
-    ThreadSafePrintf("Shutting down worker\n");
+    ThreadSafePrintf("Shutting down worker %u\n", pWorker->index);
 }
 
 
 TaskManager::TaskManager()
-    : m_RunWorkers(true),
+    : m_NumThreads(0),
     m_Tasks(),
+    m_SkippedPops(),
+    m_MainThreadTasks(),
+    m_MainThreadLock(),
+    m_Workers(),
+    m_CoreNumaNodes(),
+    m_NumaNodeCount(1),
+    m_PinWorkers(false),
+    m_WorkerMutex(),
     m_Mutex(),
     m_WakeCondition(),
+    m_NumQueuedTasks(0),
+    m_NumSleepingWorkers(0),
     m_FinishedFence(0),
     m_CurrentFence(0),
     m_QueueLock()
 {
-	uint32_t numThreads = std::min(std::max(1U, std::thread::hardware_concurrency()), MAX_THREADS);
-	ThreadSafePrintf("TaskManager: Starting up %u threads\n", numThreads);
+	QueryTopology();
 
-    //Yes run all workers
-    m_RunWorkers = true;
+	uint32_t numThreads = std::max(1U, std::thread::hardware_concurrency());
+	ThreadSafePrintf("TaskManager: Starting up %u threads (%u NUMA nodes)\n", numThreads, m_NumaNodeCount);
     
 	//Startup all the threads
-	for (uint32_t i = 0; i < numThreads; i++)
-	{
-		std::thread worker(TaskManager::TaskThread);
-		worker.detach();
-	}
+	std::lock_guard<std::mutex> lock(m_WorkerMutex);
+	StartWorkers(numThreads);
 }
 
 
@@ -55,27 +98,104 @@ TaskManager::~TaskManager()
 {
 	ThreadSafePrintf("TaskManager: Waiting for tasks to finish\n");
     
-    //No stop run all workers
-    m_RunWorkers = false;
-    
-    //Notify all workers to check
-    m_WakeCondition.notify_all();
-    
-    //Then we wait
 	Wait();
+
+	//Stop and join all workers
+	{
+		std::lock_guard<std::mutex> lock(m_WorkerMutex);
+		StopWorkers(0);
+	}
     
 	ThreadSafePrintf("TaskManager: All tasks are finished\n");
 }
 
 
-void TaskManager::Execute(const std::function<void()>& pTask)
+void TaskManager::Execute(const std::function<void()>& pTask, TaskPriority priority, const char* name)
 {
+	assert(priority < PRIORITY_COUNT);
 	m_CurrentFence++;
 
-	std::lock_guard<SpinLock> lock(m_QueueLock);
-	m_Tasks.push(pTask);
+	const bool isProfiling = TaskProfiler::IsEnabled();
+	uint32_t queueDepth = 0;
+	{
+		std::lock_guard<SpinLock> lock(m_QueueLock);
+		m_Tasks[priority].push({ pTask, name, isProfiling ? TaskProfiler::Get().GetTimestamp() : 0 });
+		queueDepth = ++m_NumQueuedTasks;
+	}
+
+	if (isProfiling)
+		TaskProfiler::Get().RecordQueueDepth(queueDepth);
+
+	//Only take the mutex when someone is actually sleeping
+	if (m_NumSleepingWorkers.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_WakeCondition.notify_one();
+	}
+}
+
+
+void TaskManager::ExecuteOnMainThread(const std::function<void()>& task, const char* name)
+{
+	uint64_t enqueueTime = TaskProfiler::IsEnabled() ? TaskProfiler::Get().GetTimestamp() : 0;
+
+	std::lock_guard<SpinLock> lock(m_MainThreadLock);
+	m_MainThreadTasks.push({ task, name, enqueueTime });
+}
+
 
-	m_WakeCondition.notify_one();
+void TaskManager::ExecuteMainThreadTasks(float budgetMilliseconds)
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	Clock::time_point start = Clock::now();
+	do
+	{
+		Task task;
+		{
+			std::lock_guard<SpinLock> lock(m_MainThreadLock);
+			if (m_MainThreadTasks.empty())
+				return;
+
+			task = std::move(m_MainThreadTasks.front());
+			m_MainThreadTasks.pop();
+		}
+
+		RunTask(task, PRIORITY_CRITICAL);
+	} while (std::chrono::duration<float, std::milli>(Clock::now() - start).count() < budgetMilliseconds);
+}
+
+
+void TaskManager::SetWorkerCount(uint32_t numWorkers)
+{
+	//A worker would end up joining itself
+	assert(s_WorkerIndex < 0);
+
+	numWorkers = std::max(1U, numWorkers);
+
+	std::lock_guard<std::mutex> lock(m_WorkerMutex);
+	if (numWorkers < m_Workers.size())
+		StopWorkers(numWorkers);
+	else
+		StartWorkers(numWorkers);
+
+	ThreadSafePrintf("TaskManager: Running %u threads\n", m_NumThreads.load());
+}
+
+
+void TaskManager::SetThreadAffinity(bool pinWorkers)
+{
+	assert(s_WorkerIndex < 0);
+
+	std::lock_guard<std::mutex> lock(m_WorkerMutex);
+	if (m_PinWorkers == pinWorkers)
+		return;
+
+	//Restart the workers so that they pick up their new core and NUMA node
+	uint32_t numWorkers = uint32_t(m_Workers.size());
+	StopWorkers(0);
+	m_PinWorkers = pinWorkers;
+	StartWorkers(numWorkers);
 }
 
 
@@ -83,27 +203,201 @@ void TaskManager::Wait()
 {
 	while (!IsFinished())
 	{
-		Poll();
+		if (!ExecuteNextTask())
+			std::this_thread::yield();
+	}
+}
+
+
+void TaskManager::WaitForCounter(const std::atomic<size_t>& counter)
+{
+	while (counter.load(std::memory_order_acquire) > 0)
+	{
+		if (!ExecuteNextTask())
+			std::this_thread::yield();
+	}
+}
+
+
+void TaskManager::StartWorkers(uint32_t numWorkers)
+{
+	const uint32_t numCores = uint32_t(m_CoreNumaNodes.size());
+	while (m_Workers.size() < numWorkers)
+	{
+		Worker* pWorker = new Worker();
+		pWorker->isRunning	= true;
+		pWorker->index		= uint32_t(m_Workers.size());
+		pWorker->core		= -1;
+		pWorker->numaNode	= -1;
+
+		if (m_PinWorkers)
+		{
+			//Leave the first core for the main thread
+			pWorker->core = int32_t((pWorker->index + 1) % numCores);
+
+			//The allocators only has to care about NUMA when there is more than one node
+			if (m_NumaNodeCount > 1)
+				pWorker->numaNode = m_CoreNumaNodes[pWorker->core];
+		}
+
+		pWorker->thread = std::thread(&TaskManager::WorkerThread, this, pWorker);
+		if (pWorker->core >= 0 && !PinThreadToCore(pWorker->thread, uint32_t(pWorker->core)))
+		{
+			ThreadSafePrintf("TaskManager: Failed to pin worker %u to core %d\n", pWorker->index, pWorker->core);
+		}
+
+		m_Workers.push_back(pWorker);
+	}
+
+	m_NumThreads = uint32_t(m_Workers.size());
+}
+
+
+void TaskManager::StopWorkers(uint32_t numWorkers)
+{
+	if (numWorkers >= m_Workers.size())
+		return;
+
+	for (size_t i = numWorkers; i < m_Workers.size(); i++)
+		m_Workers[i]->isRunning = false;
+
+	//Take the mutex so that no worker misses the notification between checking and sleeping
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_WakeCondition.notify_all();
 	}
+
+	//Tasks that are still queued are picked up by the remaining workers or the next ones started
+	for (size_t i = numWorkers; i < m_Workers.size(); i++)
+	{
+		m_Workers[i]->thread.join();
+		delete m_Workers[i];
+	}
+
+	m_Workers.resize(numWorkers);
+	m_NumThreads = numWorkers;
 }
 
 
-void TaskManager::Poll()
+void TaskManager::QueryTopology()
 {
-	m_WakeCondition.notify_one();
-	std::this_thread::yield();
+	const uint32_t numCores = std::max(1U, std::thread::hardware_concurrency());
+	m_CoreNumaNodes.assign(numCores, 0);
+	m_NumaNodeCount = 1;
+
+#if defined(__linux__)
+	//Each node lists its cores as ranges, e.g. "0-7,16-23"
+	for (uint32_t node = 0; ; node++)
+	{
+		std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+		if (!file.is_open())
+			break;
+
+		std::string range;
+		while (std::getline(file, range, ','))
+		{
+			uint32_t first = 0;
+			uint32_t last = 0;
+			char separator = 0;
+
+			std::stringstream rangeStream(range);
+			rangeStream >> first;
+			last = first;
+			if (rangeStream >> separator && separator == '-')
+				rangeStream >> last;
+
+			for (uint32_t core = first; core <= last && core < numCores; core++)
+				m_CoreNumaNodes[core] = int32_t(node);
+		}
+
+		m_NumaNodeCount = node + 1;
+	}
+#endif
 }
 
 
-bool TaskManager::Poptask(std::function<void()>& task)
+bool TaskManager::Poptask(Task& task, TaskPriority& priority)
 {
 	std::lock_guard<SpinLock> lock(m_QueueLock);
-	if (!m_Tasks.empty())
+	
+	//Take the highest priority task, but a lower priority queue that has been skipped too many times gets to go first
+	int32_t selected = -1;
+	for (uint32_t i = 0; i < PRIORITY_COUNT; i++)
+	{
+		if (m_Tasks[i].empty())
+			continue;
+
+		if (selected < 0)
+		{
+			selected = int32_t(i);
+		}
+		else if (++m_SkippedPops[i] >= TASK_STARVATION_LIMIT)
+		{
+			selected = int32_t(i);
+			break;
+		}
+	}
+
+	if (selected < 0)
+		return false;
+
+	m_SkippedPops[selected] = 0;
+	priority = TaskPriority(selected);
+	task = std::move(m_Tasks[selected].front());
+	m_Tasks[selected].pop();
+	m_NumQueuedTasks--;
+	return true;
+}
+
+
+void TaskManager::RunTask(Task& task, TaskPriority priority)
+{
+	if (!TaskProfiler::IsEnabled())
 	{
-		task = m_Tasks.front();
-		m_Tasks.pop();
+		task.func();
+		return;
+	}
+
+	//Tasks queued before profiling was enabled has no enqueue time
+	TaskProfiler& profiler = TaskProfiler::Get();
+	uint64_t startTime = profiler.GetTimestamp();
+	uint64_t enqueueTime = task.enqueueTime > 0 ? task.enqueueTime : startTime;
+
+	task.func();
+
+	profiler.RecordTask(task.name, priority, enqueueTime, startTime, profiler.GetTimestamp());
+}
+
+
+bool TaskManager::ExecuteNextTask()
+{
+	Task task;
+	TaskPriority priority;
+	if (Poptask(task, priority))
+	{
+		if (TaskProfiler::IsEnabled())
+			TaskProfiler::Get().RecordQueueDepth(m_NumQueuedTasks.load());
+
+		TaskPriority lastPriority = s_CurrentPriority;
+		s_CurrentPriority = priority;
+		
+		RunTask(task, priority);
+		
+		s_CurrentPriority = lastPriority;
+		m_FinishedFence.fetch_add(1);
 		return true;
 	}
 
 	return false;
 }
+
+
+size_t TaskManager::CalculateGrainSize(size_t count, size_t grainSize) const
+{
+	if (grainSize > 0)
+		return grainSize;
+
+	//Aim for a few chunks per thread (workers + caller) so uneven chunks still balance out
+	size_t numChunks = size_t(m_NumThreads.load() + 1) * TASK_CHUNKS_PER_THREAD;
+	return std::max<size_t>(1, (count + numChunks - 1) / numChunks);
+}
@@ -5,14 +5,46 @@
 #include <thread>
 #include <cassert>
 #include <functional>
+#include <algorithm>
+#include <vector>
+#include <atomic>
 #include <condition_variable>
+#include <coroutine>
 #include "SpinLock.h"
 #include "Helpers.h"
 
-#define MAX_THREADS 8U
+#define TASK_CHUNKS_PER_THREAD 4U
+#define TASK_STARVATION_LIMIT 16U
+#define MAIN_THREAD_TASK_BUDGET_MS 2.0f
 
 class TaskManager
 {
+public:
+	enum TaskPriority : unsigned char
+	{
+		PRIORITY_CRITICAL,
+		PRIORITY_NORMAL,
+		PRIORITY_BACKGROUND,
+		PRIORITY_COUNT
+	};
+
+private:
+	struct Task
+	{
+		std::function<void()> func;
+		const char* name;
+		uint64_t enqueueTime;
+	};
+
+	struct Worker
+	{
+		std::thread thread;
+		std::atomic_bool isRunning;
+		uint32_t index;
+		int32_t core;
+		int32_t numaNode;
+	};
+
 public:
 	TaskManager(const TaskManager& other) = delete;
 	TaskManager(TaskManager&& other) = delete;
@@ -22,30 +54,114 @@ public:
 	TaskManager();
 	~TaskManager();
 
-	void Execute(const std::function<void()>& task);
+	//name is shown in the task profiler and has to be a string literal
+	void Execute(const std::function<void()>& task, TaskPriority priority = PRIORITY_NORMAL, const char* name = "Task");
 	void Wait();
 
+	//Tasks that has to run on the main thread (GL calls etc.), drained by Game::Run every frame
+	void ExecuteOnMainThread(const std::function<void()>& task, const char* name = "Main thread task");
+	//Runs main thread tasks until the queue is empty or the budget is spent, at least one task is always run
+	void ExecuteMainThreadTasks(float budgetMilliseconds);
+
+	inline size_t GetMainThreadTaskCount()
+	{
+		std::lock_guard<SpinLock> lock(m_MainThreadLock);
+		return m_MainThreadTasks.size();
+	}
+
+	//Calls func(i) for every i in [begin, end). A grainSize of zero lets the taskmanager pick one.
+	template<typename Func>
+	void ParallelFor(size_t begin, size_t end, size_t grainSize, const Func& func);
+
+	//Combines map(i) for every i in [begin, end) with reduce. Partial results are combined in index order.
+	template<typename T, typename MapFunc, typename ReduceFunc>
+	T ParallelReduce(size_t begin, size_t end, size_t grainSize, const T& identity, const MapFunc& map, const ReduceFunc& reduce);
+
+	struct ScheduleAwaiter
+	{
+		inline bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		inline void await_suspend(std::coroutine_handle<> handle) const
+		{
+			TaskManager::Get().Execute([handle] { handle.resume(); }, priority, name);
+		}
+
+		inline void await_resume() const noexcept
+		{
+		}
+
+		TaskPriority priority;
+		const char* name;
+	};
+
+	//co_await Schedule() continues the coroutine on a worker, it can also be used to give the worker back to the queue
+	inline ScheduleAwaiter Schedule(TaskPriority priority = PRIORITY_NORMAL, const char* name = "Coroutine")
+	{
+		return ScheduleAwaiter{ priority, name };
+	}
+
+	//Executes queued tasks on the calling thread until counter reaches zero
+	void WaitForCounter(const std::atomic<size_t>& counter);
+
+	//Starts or joins workers until there are numWorkers running, may not be called from a worker
+	void SetWorkerCount(uint32_t numWorkers);
+	//Pins worker i to core i + 1 and lets its allocators place memory on that core's NUMA node
+	void SetThreadAffinity(bool pinWorkers);
     
 	inline bool IsFinished() const
 	{
-		return m_CurrentFence <= m_FinishedFence.load();
+		return m_CurrentFence.load() <= m_FinishedFence.load();
+	}
+
+	inline uint32_t GetThreadCount() const
+	{
+		return m_NumThreads;
+	}
+
+	inline uint32_t GetNumaNodeCount() const
+	{
+		return m_NumaNodeCount;
+	}
+
+	inline bool HasThreadAffinity() const
+	{
+		return m_PinWorkers;
+	}
+
+	//Returns -1 when called from a thread that is not a worker
+	inline static int32_t GetCurrentWorkerIndex()
+	{
+		return s_WorkerIndex;
 	}
-    
-    
-    inline bool ShouldRunWorker() const
-    {
-        return m_RunWorkers;
-    }
 private:
-	void Poll();
-	bool Poptask(std::function<void()>& task);
+	void WorkerThread(Worker* pWorker);
+	void StartWorkers(uint32_t numWorkers);
+	void StopWorkers(uint32_t numWorkers);
+	void QueryTopology();
+	bool Poptask(Task& task, TaskPriority& priority);
+	void RunTask(Task& task, TaskPriority priority);
+	bool ExecuteNextTask();
+	size_t CalculateGrainSize(size_t count, size_t grainSize) const;
 private:
-    bool m_RunWorkers;
-    std::queue<std::function<void()>> m_Tasks;
+    std::atomic<uint32_t> m_NumThreads;
+    std::queue<Task> m_Tasks[PRIORITY_COUNT];
+    uint32_t m_SkippedPops[PRIORITY_COUNT];
+    std::queue<Task> m_MainThreadTasks;
+    SpinLock m_MainThreadLock;
+    std::vector<Worker*> m_Workers;
+    std::vector<int32_t> m_CoreNumaNodes;
+    uint32_t m_NumaNodeCount;
+    bool m_PinWorkers;
+    std::mutex m_WorkerMutex;
     std::mutex m_Mutex;
     std::condition_variable m_WakeCondition;
+    std::atomic<uint32_t> m_NumQueuedTasks;
+    std::atomic<uint32_t> m_NumSleepingWorkers;
     std::atomic<uint64_t> m_FinishedFence;
-    uint64_t m_CurrentFence;
+    std::atomic<uint64_t> m_CurrentFence;
     SpinLock m_QueueLock;
 public:
 	inline static TaskManager& Get()
@@ -54,6 +170,78 @@ public:
 		return taskmanager;
 	}
 private:
-	static void TaskThread();
+	inline static thread_local int32_t s_WorkerIndex = -1;
+
+	//Priority of the task currently running on this thread, inherited by ParallelFor-chunks
+	inline static thread_local TaskPriority s_CurrentPriority = PRIORITY_NORMAL;
 };
 
+template<typename Func>
+inline void TaskManager::ParallelFor(size_t begin, size_t end, size_t grainSize, const Func& func)
+{
+	if (begin >= end)
+		return;
+
+	const size_t count		= end - begin;
+	const size_t grain		= CalculateGrainSize(count, grainSize);
+	const size_t numChunks	= (count + grain - 1) / grain;
+
+	//Split the range into chunks, the first one is run by the caller
+	std::atomic<size_t> chunksLeft(numChunks - 1);
+	for (size_t chunk = 1; chunk < numChunks; chunk++)
+	{
+		size_t chunkBegin	= begin + chunk * grain;
+		size_t chunkEnd		= std::min(chunkBegin + grain, end);
+		Execute([&func, &chunksLeft, chunkBegin, chunkEnd]
+		{
+			for (size_t i = chunkBegin; i < chunkEnd; i++)
+				func(i);
+
+			chunksLeft.fetch_sub(1, std::memory_order_release);
+		}, s_CurrentPriority, "ParallelFor");
+	}
+
+	const size_t firstEnd = std::min(begin + grain, end);
+	for (size_t i = begin; i < firstEnd; i++)
+		func(i);
+
+	//Help out with the queue instead of sleeping, this way nested calls never deadlock
+	WaitForCounter(chunksLeft);
+}
+
+template<typename T, typename MapFunc, typename ReduceFunc>
+inline T TaskManager::ParallelReduce(size_t begin, size_t end, size_t grainSize, const T& identity, const MapFunc& map, const ReduceFunc& reduce)
+{
+	if (begin >= end)
+		return identity;
+
+	const size_t count		= end - begin;
+	const size_t grain		= CalculateGrainSize(count, grainSize);
+	const size_t numChunks	= (count + grain - 1) / grain;
+
+	//Every chunk writes its own padded slot, std::vector<bool> would pack the results into shared bytes and
+	//neighbouring chunks would race on them
+	struct alignas(64) Partial
+	{
+		T value;
+	};
+
+	std::vector<Partial> partials(numChunks, Partial{ identity });
+	ParallelFor(0, numChunks, 1, [&](size_t chunk)
+	{
+		size_t chunkBegin	= begin + chunk * grain;
+		size_t chunkEnd		= std::min(chunkBegin + grain, end);
+
+		T result = identity;
+		for (size_t i = chunkBegin; i < chunkEnd; i++)
+			result = reduce(result, map(i));
+
+		partials[chunk].value = result;
+	});
+
+	T result = identity;
+	for (const Partial& partial : partials)
+		result = reduce(result, partial.value);
+
+	return result;
+}
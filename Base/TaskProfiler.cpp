@@ -0,0 +1,181 @@
+#include "TaskProfiler.h"
+#include "TaskManager.h"
+#include <fstream>
+#include <algorithm>
+
+static void WriteJsonString(std::ofstream& file, const char* str)
+{
+	file << '"';
+	for (const char* c = str; *c; c++)
+	{
+		if (*c == '"' || *c == '\\')
+			file << '\\';
+		file << *c;
+	}
+	file << '"';
+}
+
+TaskProfiler::TaskProfiler()
+	: m_Epoch(std::chrono::steady_clock::now()),
+	m_Buffers(),
+	m_BufferLock()
+{
+}
+
+TaskProfiler::~TaskProfiler()
+{
+	s_Enabled = false;
+
+	for (ThreadBuffer* pBuffer : m_Buffers)
+		delete pBuffer;
+}
+
+void TaskProfiler::Enable()
+{
+	s_Enabled = true;
+}
+
+void TaskProfiler::Disable()
+{
+	s_Enabled = false;
+}
+
+void TaskProfiler::Clear()
+{
+	std::scoped_lock<SpinLock> lock(m_BufferLock);
+	for (ThreadBuffer* pBuffer : m_Buffers)
+	{
+		std::scoped_lock<SpinLock> bufferLock(pBuffer->lock);
+		pBuffer->tasks.clear();
+		pBuffer->counters.clear();
+	}
+}
+
+TaskProfiler::ThreadBuffer& TaskProfiler::GetThreadBuffer()
+{
+	if (s_pThreadBuffer)
+		return *s_pThreadBuffer;
+
+	//Buffers are owned by the profiler so that events survive workers that are shut down
+	ThreadBuffer* pBuffer = new ThreadBuffer();
+	int32_t workerIndex = TaskManager::GetCurrentWorkerIndex();
+	
+	std::scoped_lock<SpinLock> lock(m_BufferLock);
+	pBuffer->threadId = uint32_t(m_Buffers.size());
+	if (workerIndex >= 0)
+		pBuffer->name = "Worker " + std::to_string(workerIndex);
+	else
+		pBuffer->name = "Thread " + std::to_string(pBuffer->threadId);
+
+	m_Buffers.push_back(pBuffer);
+	s_pThreadBuffer = pBuffer;
+	return *pBuffer;
+}
+
+void TaskProfiler::RecordTask(const char* name, uint32_t priority, uint64_t enqueueTime, uint64_t startTime, uint64_t endTime)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+	std::scoped_lock<SpinLock> lock(buffer.lock);
+	buffer.tasks.push_back({ name, enqueueTime, startTime, endTime, priority });
+}
+
+void TaskProfiler::RecordQueueDepth(uint32_t queueDepth)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+	std::scoped_lock<SpinLock> lock(buffer.lock);
+	buffer.counters.push_back({ GetTimestamp(), queueDepth });
+}
+
+bool TaskProfiler::ExportChromeTrace(const std::string& filename)
+{
+	std::ofstream file(filename, std::ios_base::out | std::ios_base::trunc);
+	if (!file.is_open())
+	{
+		ThreadSafePrintf("TaskProfiler: Failed to open [%s]\n", filename.c_str());
+		return false;
+	}
+
+	static const char* priorityNames[] = { "Critical", "Normal", "Background" };
+
+	std::scoped_lock<SpinLock> lock(m_BufferLock);
+	
+	//Queue depth is sampled on every thread, merge the samples so that the counter track is in order
+	std::vector<CounterEvent> counters;
+	uint64_t traceBegin = UINT64_MAX;
+	uint64_t traceEnd = 0;
+	for (ThreadBuffer* pBuffer : m_Buffers)
+	{
+		std::scoped_lock<SpinLock> bufferLock(pBuffer->lock);
+		counters.insert(counters.end(), pBuffer->counters.begin(), pBuffer->counters.end());
+		for (const TaskEvent& event : pBuffer->tasks)
+		{
+			traceBegin = std::min(traceBegin, event.startTime);
+			traceEnd = std::max(traceEnd, event.endTime);
+		}
+	}
+
+	std::sort(counters.begin(), counters.end(), [](const CounterEvent& a, const CounterEvent& b)
+	{
+		return a.time < b.time;
+	});
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	for (ThreadBuffer* pBuffer : m_Buffers)
+	{
+		std::scoped_lock<SpinLock> bufferLock(pBuffer->lock);
+
+		file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << pBuffer->threadId << ",\"args\":{\"name\":";
+		WriteJsonString(file, pBuffer->name.c_str());
+		file << "}}";
+		first = false;
+
+		std::vector<std::pair<uint64_t, uint64_t>> intervals;
+		for (const TaskEvent& event : pBuffer->tasks)
+		{
+			file << ",\n{\"name\":";
+			WriteJsonString(file, event.name);
+			file << ",\"cat\":\"" << priorityNames[event.priority] << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << pBuffer->threadId;
+			file << ",\"ts\":" << event.startTime << ",\"dur\":" << (event.endTime - event.startTime);
+			file << ",\"args\":{\"queued_us\":" << (event.startTime - event.enqueueTime) << "}}";
+
+			intervals.push_back({ event.startTime, event.endTime });
+		}
+
+		//Tasks run while waiting inside another task are nested, only count the time once
+		std::sort(intervals.begin(), intervals.end());
+		uint64_t busyTime = 0;
+		uint64_t busyEnd = 0;
+		for (const std::pair<uint64_t, uint64_t>& interval : intervals)
+		{
+			uint64_t begin = std::max(interval.first, busyEnd);
+			if (interval.second > begin)
+			{
+				busyTime += interval.second - begin;
+				busyEnd = interval.second;
+			}
+		}
+
+		if (traceEnd > traceBegin)
+		{
+			ThreadSafePrintf("TaskProfiler: %s ran %llu tasks, %.1f%% busy\n", pBuffer->name.c_str(),
+				(unsigned long long)pBuffer->tasks.size(), 100.0 * double(busyTime) / double(traceEnd - traceBegin));
+		}
+	}
+
+	for (const CounterEvent& counter : counters)
+	{
+		file << (first ? "" : ",\n") << "{\"name\":\"Queued tasks\",\"ph\":\"C\",\"pid\":0,\"ts\":" << counter.time << ",\"args\":{\"tasks\":" << counter.queueDepth << "}}";
+		first = false;
+	}
+	file << "\n]}\n";
+
+	ThreadSafePrintf("TaskProfiler: Saved trace to [%s]\n", filename.c_str());
+	return true;
+}
+
+TaskProfiler& TaskProfiler::Get()
+{
+	static TaskProfiler profiler;
+	return profiler;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <string>
+#include <chrono>
+#include "SpinLock.h"
+
+#define TASK_TRACE_PATH "task_trace.json"
+
+//Records when tasks are queued, started and finished. Nothing is recorded unless Enable() has been called,
+//the cost when disabled is one relaxed atomic load per task.
+class TaskProfiler
+{
+	struct TaskEvent
+	{
+		const char* name;
+		uint64_t enqueueTime;
+		uint64_t startTime;
+		uint64_t endTime;
+		uint32_t priority;
+	};
+
+	struct CounterEvent
+	{
+		uint64_t time;
+		uint32_t queueDepth;
+	};
+
+	struct ThreadBuffer
+	{
+		SpinLock lock;
+		std::string name;
+		uint32_t threadId;
+		std::vector<TaskEvent> tasks;
+		std::vector<CounterEvent> counters;
+	};
+
+public:
+	TaskProfiler(const TaskProfiler& other) = delete;
+	TaskProfiler(TaskProfiler&& other) = delete;
+	TaskProfiler& operator=(const TaskProfiler& other) = delete;
+	TaskProfiler& operator=(TaskProfiler&& other) = delete;
+
+	~TaskProfiler();
+
+	void Enable();
+	void Disable();
+	void Clear();
+
+	//name has to outlive the profiler, string literals are expected
+	void RecordTask(const char* name, uint32_t priority, uint64_t enqueueTime, uint64_t startTime, uint64_t endTime);
+	void RecordQueueDepth(uint32_t queueDepth);
+
+	//Writes Chrome trace-event JSON (chrome://tracing or ui.perfetto.dev) and prints the utilization of every thread
+	bool ExportChromeTrace(const std::string& filename);
+
+	//Microseconds since the profiler was created
+	inline uint64_t GetTimestamp() const
+	{
+		return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_Epoch).count());
+	}
+
+	inline static bool IsEnabled()
+	{
+		return s_Enabled.load(std::memory_order_relaxed);
+	}
+
+	static TaskProfiler& Get();
+
+private:
+	TaskProfiler();
+	ThreadBuffer& GetThreadBuffer();
+
+private:
+	std::chrono::steady_clock::time_point m_Epoch;
+	std::vector<ThreadBuffer*> m_Buffers;
+	SpinLock m_BufferLock;
+
+	inline static std::atomic_bool s_Enabled = false;
+	inline static thread_local ThreadBuffer* s_pThreadBuffer = nullptr;
+};
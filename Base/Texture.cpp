@@ -1,4 +1,5 @@
 #include "Texture.h"
+#include <algorithm>
 
 const sf::Texture& Texture::GetSFTexture()
 {
@@ -7,6 +8,57 @@ const sf::Texture& Texture::GetSFTexture()
 
 void Texture::Init()
 {
+	size_t bytesUploaded = 0;
+	while (!InitPartial(SIZE_MAX, bytesUploaded)) {}
+}
+
+bool Texture::InitPartial(size_t maxBytes, size_t& bytesUploaded)
+{
+	const sf::Vector2u size = m_Image.getSize();
+	const size_t rowBytes = std::max<size_t>(size_t(size.x) * 4, 1);
+	if (m_UploadedRows == 0)
+	{
+		m_Texture.setSrgb(false);
+		m_Texture.create(size.x, size.y);
+		m_Texture.setRepeated(true);
+		m_Texture.setSmooth(false);
+	}
+
+	//Always upload at least one row so that a small budget still makes progress
+	size_t numRows = std::max<size_t>(maxBytes / rowBytes, 1);
+	numRows = std::min<size_t>(numRows, size.y - m_UploadedRows);
+	if (numRows > 0)
+	{
+		m_Texture.update(m_Image.getPixelsPtr() + m_UploadedRows * rowBytes, size.x, unsigned(numRows), 0, m_UploadedRows);
+		m_UploadedRows += unsigned(numRows);
+	}
+	
+	bytesUploaded = numRows * rowBytes;
+	if (m_UploadedRows < size.y)
+		return false;
+
+	m_Texture.generateMipmap();
+	m_Image = sf::Image();
+	return true;
+}
+
+bool Texture::TakePayload(IResource* pSource)
+{
+	Texture* pTexture = dynamic_cast<Texture*>(pSource);
+	if (!pTexture)
+		return false;
+
+	//The texture object is kept and recreated with the new size on the next upload
+	std::swap(m_Image, pTexture->m_Image);
+	m_UploadedRows = 0;
+	return true;
+}
+
+size_t Texture::GetPayloadSize() const
+{
+	//Packaged textures are the width and height followed by the pixels
+	const sf::Vector2u size = m_Image.getSize();
+	return size_t(size.x) * size.y * 4 + 2 * sizeof(short int);
 }
 
 void Texture::Release()
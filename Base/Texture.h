@@ -5,21 +5,23 @@
 class Texture : public IResource
 {
 	sf::Texture m_Texture;
+	sf::Image m_Image;
+	unsigned int m_UploadedRows;
 
 public:
 	inline Texture(int width, int height, unsigned char* pixelData)
+		: m_UploadedRows(0)
 	{
-		sf::Image image;
-		image.create(width, height, pixelData);
-		m_Texture.loadFromImage(image, sf::IntRect());
-        m_Texture.setRepeated(true);
-        m_Texture.setSmooth(false);
-        m_Texture.setSrgb(false);
-        m_Texture.generateMipmap();
+		//The pixels are kept until the texture has been uploaded on the main thread
+		m_Image.create(width, height, pixelData);
 	}
 
 	const sf::Texture& GetSFTexture();
 
 	virtual void Init() override;
 	virtual void Release() override;
+	//Uploads a band of rows, mipmaps are generated once the last row is uploaded
+	virtual bool InitPartial(size_t maxBytes, size_t& bytesUploaded) override;
+	virtual bool TakePayload(IResource* pSource) override;
+	virtual size_t GetPayloadSize() const override;
 };
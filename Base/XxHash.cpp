@@ -0,0 +1,106 @@
+#include "XxHash.h"
+#include <cstring>
+
+static constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ull;
+static constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+static constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ull;
+static constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ull;
+static constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ull;
+
+uint64_t XxHash::Hash64(const void* pData, size_t size, uint64_t seed)
+{
+	const uint8_t* pPosition = reinterpret_cast<const uint8_t*>(pData);
+	const uint8_t* pEnd = pPosition + size;
+	uint64_t hash;
+
+	//Four independent lanes over 32 byte stripes, so the multiplies of one stripe do not wait on each other
+	if (size >= 32)
+	{
+		uint64_t lane1 = seed + PRIME64_1 + PRIME64_2;
+		uint64_t lane2 = seed + PRIME64_2;
+		uint64_t lane3 = seed;
+		uint64_t lane4 = seed - PRIME64_1;
+		const uint8_t* pLimit = pEnd - 32;
+		do
+		{
+			lane1 = Round(lane1, Read64(pPosition));
+			lane2 = Round(lane2, Read64(pPosition + 8));
+			lane3 = Round(lane3, Read64(pPosition + 16));
+			lane4 = Round(lane4, Read64(pPosition + 24));
+			pPosition += 32;
+		} while (pPosition <= pLimit);
+
+		hash = RotateLeft(lane1, 1) + RotateLeft(lane2, 7) + RotateLeft(lane3, 12) + RotateLeft(lane4, 18);
+		hash = MergeRound(hash, lane1);
+		hash = MergeRound(hash, lane2);
+		hash = MergeRound(hash, lane3);
+		hash = MergeRound(hash, lane4);
+	}
+	else
+	{
+		hash = seed + PRIME64_5;
+	}
+
+	hash += uint64_t(size);
+
+	//The tail that does not fill a stripe
+	for (; pPosition + 8 <= pEnd; pPosition += 8)
+	{
+		hash ^= Round(0, Read64(pPosition));
+		hash = RotateLeft(hash, 27) * PRIME64_1 + PRIME64_4;
+	}
+
+	if (pPosition + 4 <= pEnd)
+	{
+		hash ^= uint64_t(Read32(pPosition)) * PRIME64_1;
+		hash = RotateLeft(hash, 23) * PRIME64_2 + PRIME64_3;
+		pPosition += 4;
+	}
+
+	for (; pPosition < pEnd; pPosition++)
+	{
+		hash ^= uint64_t(*pPosition) * PRIME64_5;
+		hash = RotateLeft(hash, 11) * PRIME64_1;
+	}
+
+	//Avalanche
+	hash ^= hash >> 33;
+	hash *= PRIME64_2;
+	hash ^= hash >> 29;
+	hash *= PRIME64_3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+uint64_t XxHash::Round(uint64_t accumulator, uint64_t input)
+{
+	accumulator += input * PRIME64_2;
+	accumulator = RotateLeft(accumulator, 31);
+	return accumulator * PRIME64_1;
+}
+
+uint64_t XxHash::MergeRound(uint64_t accumulator, uint64_t value)
+{
+	accumulator ^= Round(0, value);
+	return accumulator * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t XxHash::Read64(const uint8_t* pData)
+{
+	//The reference reads little endian, which is what every platform this runs on is
+	uint64_t value;
+	memcpy(&value, pData, sizeof(value));
+	return value;
+}
+
+uint32_t XxHash::Read32(const uint8_t* pData)
+{
+	uint32_t value;
+	memcpy(&value, pData, sizeof(value));
+	return value;
+}
+
+uint64_t XxHash::RotateLeft(uint64_t value, uint32_t bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+//XXH64 from the xxHash family, gives the same results as the reference implementation. It is not cryptographic,
+//so callers that must not mix up different data still compare the bytes when two hashes match.
+class XxHash
+{
+public:
+	static uint64_t Hash64(const void* pData, size_t size, uint64_t seed = 0);
+
+private:
+	static uint64_t Round(uint64_t accumulator, uint64_t input);
+	static uint64_t MergeRound(uint64_t accumulator, uint64_t value);
+	static uint64_t Read64(const uint8_t* pData);
+	static uint32_t Read32(const uint8_t* pData);
+	static uint64_t RotateLeft(uint64_t value, uint32_t bits);
+};
@@ -83,7 +83,7 @@ workspace "Game Engine Architecture"
         kind "ConsoleApp"
         language "C++"
         location "Assignment1"
-        cppdialect "C++17"
+        cppdialect "C++20"
         systemversion "latest"
 		files
         {
@@ -180,7 +180,7 @@ workspace "Game Engine Architecture"
 		kind "ConsoleApp"
 		language "C++"
 		location "Assignment2"
-		cppdialect "C++17"
+		cppdialect "C++20"
 		systemversion "latest"
 		files
         {